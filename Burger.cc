@@ -22,26 +22,37 @@
 #include <deal.II/base/function.h>
 #include <deal.II/base/tensor_function.h>
 #include <deal.II/base/logstream.h>
+#include <deal.II/base/timer.h>
+#include <deal.II/base/memory_consumption.h>
+#include <deal.II/base/thread_management.h>
+#include <deal.II/base/conditional_ostream.h>
 #include <deal.II/lac/vector.h>
 #include <deal.II/lac/full_matrix.h>
 #include <deal.II/lac/compressed_sparsity_pattern.h>
+#include <deal.II/lac/dynamic_sparsity_pattern.h>
 #include <deal.II/lac/sparse_matrix.h>
 #include <deal.II/lac/solver_gmres.h>
 #include <deal.II/lac/solver_cg.h>
 #include <deal.II/lac/precondition.h>
+#include <deal.II/lac/solver_control.h>
+#include <deal.II/lac/sparse_direct.h>
 #include <deal.II/lac/constraint_matrix.h>
 #include <deal.II/grid/tria.h>
 #include <deal.II/grid/grid_generator.h>
 #include <deal.II/grid/grid_refinement.h>
 #include <deal.II/grid/grid_out.h>
+#include <deal.II/grid/grid_tools.h>
 #include <deal.II/grid/tria_accessor.h>
 #include <deal.II/grid/tria_iterator.h>
 #include <deal.II/dofs/dof_handler.h>
 #include <deal.II/dofs/dof_accessor.h>
 #include <deal.II/dofs/dof_tools.h>
+#include <deal.II/dofs/dof_renumbering.h>
 #include <deal.II/fe/fe_system.h>
 #include <deal.II/fe/fe_q.h>
+#include <deal.II/fe/fe_dgq.h>
 #include <deal.II/fe/fe_values.h>
+#include <deal.II/fe/mapping_q1.h>
 #include <deal.II/numerics/data_out.h>
 #include <deal.II/numerics/vector_tools.h>
 #include <deal.II/numerics/error_estimator.h>
@@ -50,264 +61,2278 @@
 
 #include <deal.II/lac/trilinos_precondition.h>
 
+#include <deal.II/multigrid/multigrid.h>
+#include <deal.II/multigrid/mg_transfer.h>
+#include <deal.II/multigrid/mg_tools.h>
+#include <deal.II/multigrid/mg_coarse.h>
+#include <deal.II/multigrid/mg_smoother.h>
+#include <deal.II/multigrid/mg_matrix.h>
+#include <deal.II/multigrid/mg_constrained_dofs.h>
+
 #include <deal.II/numerics/data_out.h>
 #include <fstream>
 #include <iostream>
+#include <iomanip>
 #include <cmath>
 #include <sstream>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#include <limits>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <dlfcn.h>
 #include <deal.II/base/logstream.h>
 
+#include <deal.II/lac/vector_memory.h>
+
+#include "convection_diffusion.h"
+
+#if defined(BURGER_PERF_COUNTERS) || defined(LIKWID_PERFMON)
+#  include <chrono>
+#  include <mutex>
+#endif
+#ifdef BURGER_PERF_COUNTERS
+#  include <cstring>
+#  include <linux/perf_event.h>
+#  include <sys/ioctl.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+#ifdef LIKWID_PERFMON
+#  include <likwid.h>
+#endif
+
 
 
 using namespace dealii;
 
-template <int dim>
-class Burger
+/*
+ * Number of heap allocations done through the global operator new since
+ * the program started. The counting operator new is not part of the
+ * program: it lives in allocation_counter.cc, which CMake builds as a
+ * small shared module that the check-allocations test loads with
+ * LD_PRELOAD. The module exports burger_n_allocations(), looked up here
+ * once at run time; without it enabled() is false and nothing is counted.
+ */
+namespace AllocationCounter
 {
-public:
-  Burger ();
-  ~Burger();
-  void run ();
+  typedef std::size_t (*CountFunction) ();
 
-private:
-  void make_grid ();
-  void setup_system();
-  void assemble_system_2 ();
-  void solve ();
-  void refine_grid (const unsigned int min_grid_level, const unsigned int max_grid_level);
-  void output_results () const;
+  CountFunction count_function ()
+  {
+    static const CountFunction function
+      = reinterpret_cast<CountFunction> (dlsym (RTLD_DEFAULT, "burger_n_allocations"));
+    return function;
+  }
 
-  double solution_bdf(
-    const double& sol_val,
-    const double& rhs_val,
-    const double& v_val,
-    const Tensor<1, dim>& sol_grad,
-    const Tensor<1, dim>& v_grad,
-    const Tensor<1, dim>& beta
-  ) const;
+  bool enabled ()
+  {
+    return count_function () != 0;
+  }
 
-  double solution_bdf1(
-    const double& sol_old,
-    const double& sol_old_old
-  ) const;
+  std::size_t n_allocations ()
+  {
+    return (enabled () ? count_function () () : 0);
+  }
+}
 
-  double advection_cell_operator(
-    const double& u_val,
-    const double& v_val,
-    const Tensor<1, dim>& u_grad,
-    const Tensor<1, dim>& v_grad,
-    const Tensor<1, dim>& beta
-  ) const;
 
-  double advection_face_operator(
-    const double& u_val,
-    const double& v_val,
-    const Tensor<1, dim>& beta,
-    const Tensor<1, dim>& normal
-  ) const;
 
-  double lhs_operator(
-    const double& u_val,
-    const double& v_val,
-    const Tensor<1, dim>& u_grad,
-    const Tensor<1, dim>& v_grad,
-    const double& alpha,
-    const Tensor<1, dim>& beta
-  ) const;
+/*
+ * Optional hardware counter instrumentation of the hot regions (assembly,
+ * solve, refine, output). Without the flags below BURGER_PERF_REGION
+ * expands to nothing and none of this is compiled.
+ *
+ * -DBURGER_PERF_COUNTERS: each region reads a group of Linux perf_event
+ *  counters of the calling thread: cycles, instructions, last level cache
+ *  references and misses, and, if BURGER_PERF_FLOP_EVENT holds a raw event
+ *  code in hex (e.g. FP_ARITH_INST_RETIRED on the machine at hand), the
+ *  floating point operations. The counts are accumulated per region name
+ *  and printed at program exit with the bytes moved, estimated as cache
+ *  misses times the 64 byte line, the achieved bandwidth, and, if
+ *  BURGER_PEAK_GBS and BURGER_PEAK_GFLOPS are set, the roofline bound
+ *  min(peak flops, intensity * peak bandwidth).
+ *
+ * -DLIKWID_PERFMON: the regions are also LIKWID markers, for
+ *  likwid-perfctr -m -g <group>.
+ *
+ * Work that deal.II hands to worker threads inside a region is not seen by
+ * the perf_event counters of the calling thread.
+ */
+#if defined(BURGER_PERF_COUNTERS) || defined(LIKWID_PERFMON)
+namespace PerfCounters
+{
+  enum Counter
+  {
+    cycles,
+    instructions,
+    cache_references,
+    cache_misses,
+    flops,
+    n_counters
+  };
+
+  struct Totals
+  {
+    Totals ()
+      :
+      calls (0),
+      seconds (0),
+      available (n_counters, false),
+      counts (n_counters, 0)
+    {}
+
+    unsigned long long              calls;
+    double                          seconds;
+    std::vector<bool>               available;
+    std::vector<unsigned long long> counts;
+  };
+
+  std::mutex                     totals_mutex;
+  std::map<std::string, Totals>  totals;
+
+  class Region
+  {
+  public:
+    Region (const char *name);
+    ~Region ();
+
+  private:
+    const char                                    *name;
+    std::chrono::steady_clock::time_point          start;
+#ifdef BURGER_PERF_COUNTERS
+    int                                            fds[n_counters];
+    int                                            leader;
+#endif
+  };
+
+
+
+#ifdef BURGER_PERF_COUNTERS
+  int open_counter (const unsigned int type,
+                    const unsigned long long config,
+                    const int group_fd)
+  {
+    perf_event_attr attributes;
+    std::memset (&attributes, 0, sizeof (attributes));
+    attributes.size           = sizeof (attributes);
+    attributes.type           = type;
+    attributes.config         = config;
+    attributes.disabled       = (group_fd == -1);
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv     = 1;
+    attributes.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_ID;
+    return static_cast<int> (syscall (__NR_perf_event_open, &attributes, 0, -1, group_fd, 0));
+  }
+#endif
 
-  double streamline_diffusion(
-    const Tensor<1, dim>& u_grad,
-    const Tensor<1, dim>& v_grad,
-    const Tensor<1, dim>& beta
-  ) const;
 
-  Triangulation<dim>   triangulation;
 
-  FESystem<dim>        fe;
+  Region::Region (const char *name)
+    :
+    name (name)
+  {
+#ifdef BURGER_PERF_COUNTERS
+    leader = open_counter (PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+    fds[cycles]           = leader;
+    fds[instructions]     = -1;
+    fds[cache_references] = -1;
+    fds[cache_misses]     = -1;
+    fds[flops]            = -1;
+    if (leader != -1)
+      {
+        fds[instructions]     = open_counter (PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, leader);
+        fds[cache_references] = open_counter (PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES, leader);
+        fds[cache_misses]     = open_counter (PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, leader);
+        if (const char *flop_event = std::getenv ("BURGER_PERF_FLOP_EVENT"))
+          fds[flops] = open_counter (PERF_TYPE_RAW, std::strtoull (flop_event, 0, 16), leader);
+
+        ioctl (leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl (leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+      }
+#endif
+#ifdef LIKWID_PERFMON
+    LIKWID_MARKER_START (name);
+#endif
+    start = std::chrono::steady_clock::now ();
+  }
 
-  DoFHandler<dim>      dof_handler;
 
-  ConstraintMatrix     constraints;
 
-  SparsityPattern      sparsity_pattern;
-  SparseMatrix<double> system_matrix;
+  Region::~Region ()
+  {
+    const double seconds
+      = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+#ifdef LIKWID_PERFMON
+    LIKWID_MARKER_STOP (name);
+#endif
+
+    std::vector<bool>               available (n_counters, false);
+    std::vector<unsigned long long> counts (n_counters, 0);
+#ifdef BURGER_PERF_COUNTERS
+    if (leader != -1)
+      {
+        ioctl (leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+        // Group read: the number of counters, then (value, id) pairs.
+        unsigned long long buffer[1 + 2*n_counters];
+        if (read (leader, buffer, sizeof (buffer)) > 0)
+          for (unsigned long long k=0; k<buffer[0]; ++k)
+            for (unsigned int c=0; c<n_counters; ++c)
+              {
+                unsigned long long id;
+                if ((fds[c] != -1) &&
+                    (ioctl (fds[c], PERF_EVENT_IOC_ID, &id) == 0) &&
+                    (id == buffer[2+2*k]))
+                  {
+                    available[c] = true;
+                    counts[c]    = buffer[1+2*k];
+                  }
+              }
+      }
+    for (unsigned int c=n_counters; c-- > 0; )
+      if (fds[c] != -1)
+        close (fds[c]);
+#endif
+
+    std::lock_guard<std::mutex> lock (totals_mutex);
+    Totals &region = totals[name];
+    ++region.calls;
+    region.seconds += seconds;
+    for (unsigned int c=0; c<n_counters; ++c)
+      if (available[c])
+        {
+          region.available[c] = true;
+          region.counts[c]   += counts[c];
+        }
+  }
 
-  Vector<double>       old_solution;
-  Vector<double>       old_old_solution;
-  Vector<double>       solution;
-  Vector<double>       system_rhs;
 
-  unsigned int         timestep_number;
-  double               time_step;
-  double               time;
 
-  double               theta_imex;
-  double               theta_skew;
+  void report (std::ostream &out)
+  {
+    const char  *peak_gbs_string    = std::getenv ("BURGER_PEAK_GBS");
+    const char  *peak_gflops_string = std::getenv ("BURGER_PEAK_GFLOPS");
+    const double peak_gbs           = (peak_gbs_string ? std::atof (peak_gbs_string) : 0);
+    const double peak_gflops        = (peak_gflops_string ? std::atof (peak_gflops_string) : 0);
 
-  const double         nu = 1.0;
-};
+    std::lock_guard<std::mutex> lock (totals_mutex);
+    out << "Performance counters per region:" << std::endl;
+    for (std::map<std::string, Totals>::const_iterator region = totals.begin();
+         region != totals.end(); ++region)
+      {
+        const Totals &t = region->second;
+        out << "   " << std::setw(10) << std::left << region->first << std::right
+            << " calls " << t.calls << ", " << t.seconds << " s";
+        if (t.available[cycles] && t.available[instructions])
+          out << ", IPC " << double(t.counts[instructions]) / std::max (t.counts[cycles], 1ULL);
 
+        double bytes = 0;
+        if (t.available[cache_misses])
+          {
+            bytes = 64. * t.counts[cache_misses];
+            out << ", LLC misses " << t.counts[cache_misses];
+            if (t.available[cache_references])
+              out << " (" << 100. * t.counts[cache_misses] / std::max (t.counts[cache_references], 1ULL)
+                  << " %)";
+            out << ", " << bytes / 1e9 << " GB moved, "
+                << bytes / 1e9 / t.seconds << " GB/s";
+            if (peak_gbs > 0)
+              out << " (" << 100. * bytes / 1e9 / t.seconds / peak_gbs << " % of peak)";
+          }
+        if (t.available[flops])
+          {
+            const double gflops = 1e-9 * t.counts[flops] / t.seconds;
+            out << ", " << t.counts[flops] << " FLOPs, " << gflops << " GFLOP/s";
+            if ((bytes > 0) && (peak_gbs > 0) && (peak_gflops > 0))
+              {
+                const double intensity = t.counts[flops] / bytes;
+                const double roofline  = std::min (peak_gflops, intensity * peak_gbs);
+                out << ", intensity " << intensity << " FLOP/B, roofline "
+                    << roofline << " GFLOP/s (" << 100. * gflops / roofline << " %)";
+              }
+          }
+        out << std::endl;
+      }
+  }
 
-template<int dim>
-class RightHandSide : public Function<dim>
+
+
+  void report_at_exit ()
+  {
+    report (std::cout);
+#ifdef LIKWID_PERFMON
+    LIKWID_MARKER_CLOSE;
+#endif
+  }
+
+
+
+  void initialize ()
+  {
+#ifdef LIKWID_PERFMON
+    LIKWID_MARKER_INIT;
+#endif
+    std::atexit (&report_at_exit);
+  }
+}
+
+#  define BURGER_PERF_REGION(name) PerfCounters::Region perf_region (name)
+#  define BURGER_PERF_INIT         PerfCounters::initialize ()
+#else
+#  define BURGER_PERF_REGION(name)
+#  define BURGER_PERF_INIT
+#endif
+
+/*
+ * Binary log of per-step diagnostics. Records are collected in memory and
+ * written in blocks, so logging adds no flushes to the time loop. The file
+ * starts with an eight byte tag, the format version and the record size,
+ * followed by the records as they are laid out here. plot/read_diagnostics.cc
+ * prints them as columns for gnuplot.
+ */
+class DiagnosticsLog
 {
 public:
-  RightHandSide (const double& time)
-    :
-    Function<dim>(dim),
-    period (0.2),
-    time(time)
-  {}
-  virtual double value (const Point<dim> &p,
-                        const unsigned int component = 0) const;
-  virtual void vector_value (const Point<dim>  &points,
-		  Vector<double> &value) const;
+  struct Record
+  {
+    double        time;
+    double        l2_error;
+    double        linear_residual;
+    double        assembly_time;
+    double        solve_time;
+    double        refinement_time;
+    std::uint32_t linear_iterations;
+    std::uint32_t n_dofs;
+    std::uint32_t n_cells;
+    std::uint32_t n_allocations;
+  };
+
+  // Value of Record::n_allocations if allocations are not counted.
+  static const std::uint32_t not_counted = 0xffffffff;
+
+  DiagnosticsLog (const unsigned int buffer_size = 256);
+  ~DiagnosticsLog ();
+
+  void open (const std::string &filename);
+  void add (const Record &record);
+  void flush ();
+
 private:
-  const double period;
-  const double time ;
+  std::ofstream       out;
+  std::vector<Record> buffer;
+  const unsigned int  buffer_size;
 };
 
-template<int dim>
-double RightHandSide<dim>::value (const Point<dim> &p,
-                                  const unsigned int component) const
-{
 
-  Assert (dim == 2, ExcNotImplemented());
 
-//  const double time = this->get_time();
-  const double point_within_period = (time/period - std::floor(time/period));
+const std::uint32_t DiagnosticsLog::not_counted;
 
 
-  switch(component){
-  	  case 0:
-		  if ((point_within_period >= 0.0) && (point_within_period <= 0.2))
-			{
-			  if ((p[0] > 0.5) && (p[1] > -0.5))
-				return 1;
-			  else
-				return 0;
-			}
-		  else if ((point_within_period >= 0.5) && (point_within_period <= 0.7))
-			{
-			  if ((p[0] > -0.5) && (p[1] > 0.5))
-				return 1;
-			  else
-				return 0;
-			}
-		  else
-			return 0;
 
-  	  case 1:
-		  if ((point_within_period >= 0.2) && (point_within_period <= 0.4))
-			{
-			  if ((p[0] > 0.5) && (p[1] > -0.5))
-				return 1;
-			  else
-				return 0;
-			}
-		  else if ((point_within_period >= 0.7) && (point_within_period <= 0.9))
-			{
-			  if ((p[0] > -0.5) && (p[1] > 0.5))
-				return 1;
-			  else
-				return 0;
-			}
-		  else
-			return 0;
+DiagnosticsLog::DiagnosticsLog (const unsigned int buffer_size)
+  :
+  buffer_size (buffer_size)
+{
+  buffer.reserve (buffer_size);
+}
 
-      default: return 0;
-  }
 
+
+DiagnosticsLog::~DiagnosticsLog ()
+{
+  flush ();
 }
 
-template <int dim>
-void
-RightHandSide<dim>::vector_value (const Point<dim>  &points,
-		 	 	 	 	 	 	 Vector<double> &values) const
+
+
+void DiagnosticsLog::open (const std::string &filename)
 {
+  flush ();
+  if (out.is_open())
+    out.close ();
+
+  out.open (filename.c_str(), std::ios::binary);
+  AssertThrow (out, ExcIO());
+
+  const char          tag[8]      = { 'B', 'U', 'R', 'G', 'D', 'I', 'A', 'G' };
+  const std::uint32_t version     = 2;
+  const std::uint32_t record_size = sizeof (Record);
+  out.write (tag, sizeof(tag));
+  out.write (reinterpret_cast<const char *>(&version), sizeof(version));
+  out.write (reinterpret_cast<const char *>(&record_size), sizeof(record_size));
+}
+
 
-	for (unsigned int c=0; c<this->n_components; ++c)
-	  values(c) = RightHandSide<dim>::value (points, c);
 
+void DiagnosticsLog::add (const Record &record)
+{
+  buffer.push_back (record);
+  if (buffer.size() >= buffer_size)
+    flush ();
 }
 
-template <int dim>
-void right_hand_side (const std::vector<Point<dim> > &points,
-                      std::vector<Tensor<1, dim> >   &values)
+
+
+void DiagnosticsLog::flush ()
 {
-  Assert (values.size() == points.size(),
-          ExcDimensionMismatch (values.size(), points.size()));
-  Assert (dim >= 2, ExcNotImplemented());
-  Point<dim> point_1, point_2;
-  point_1(0) = 0.5;
-  point_2(0) = -0.5;
-  for (unsigned int point_n = 0; point_n < points.size(); ++point_n)
+  if (out.is_open() && !buffer.empty())
     {
-      if (((points[point_n]-point_1).norm_square() < 0.2*0.2) ||
-          ((points[point_n]-point_2).norm_square() < 0.2*0.2))
-        values[point_n][0] = 1.0;
-      else
-        values[point_n][0] = 0.0;
-      if (points[point_n].norm_square() < 0.2*0.2)
-        values[point_n][1] = 1.0;
-      else
-        values[point_n][1] = 0.0;
+      out.write (reinterpret_cast<const char *>(&buffer[0]),
+                 buffer.size() * sizeof (Record));
+      out.flush ();
     }
+  buffer.clear ();
 }
 
-/*
 
-template<int dim>
-class RightHandSide1 : public Function<dim>
+/*
+ * Spatial index for locating points in the active cells of a
+ * triangulation. The bounding box of the domain is divided into a uniform
+ * grid of buckets, and every cell of the anchor level (the coarsest level
+ * on which the whole domain is covered by existing cells, i.e. the lowest
+ * active level) is entered into the buckets its bounding box overlaps. A
+ * point is located by testing the few anchor cells of its bucket and then
+ * descending through the children to the active cell. Refinement leaves the
+ * anchor cells in place, so update() only rebuilds the buckets if
+ * coarsening removed cells of the anchor level.
+ */
+template <int dim>
+class CellLocator
 {
 public:
-  RightHandSide1 (const double& time) : Function<dim>(), time(time) {}
-  virtual double value (const Point<dim> &p,
-                        const unsigned int component = 0) const;
-  const double time;
+  CellLocator (const Triangulation<dim> &triangulation,
+               const unsigned int        n_buckets_per_direction = 16);
+
+  void update ();
+
+  std::pair<typename Triangulation<dim>::active_cell_iterator, Point<dim> >
+  locate (const Point<dim> &point) const;
 
+  void sample (const DoFHandler<dim>            &dof_handler,
+               const Vector<double>             &solution,
+               const std::vector<Point<dim> >   &points,
+               std::vector<Vector<double> >     &values) const;
+
+private:
+  void rebuild ();
+  unsigned int bucket (const Point<dim> &point) const;
+  static bool in_bounding_box (const typename Triangulation<dim>::cell_iterator &cell,
+                               const Point<dim>                                 &point);
+
+  const SmartPointer<const Triangulation<dim> >             triangulation;
+  const unsigned int                                        n_buckets_per_direction;
+  MappingQ1<dim>                                            mapping;
+
+  unsigned int                                              anchor_level;
+  Point<dim>                                                lower_corner;
+  Point<dim>                                                bucket_size;
+  std::vector<std::vector<typename Triangulation<dim>::cell_iterator> > buckets;
 };
 
-template<int dim>
-double RightHandSide1<dim> ::value(const Point<dim> &p,
-		                    const unsigned int component) const{
 
-	return std::exp(-time)*(5 - 3*p[0]*p[0] -3*p[1]*p[1] + p[0]*p[0]*p[1]*p[1]);
-}
-*/
-//////////////////////////
 
 template <int dim>
-class RightHandSide1 : public Function<dim>
-{
-public:
-  RightHandSide1 () : Function<dim>(dim) {}
-  virtual double value (const Point<dim>   &p,
-						const unsigned int  component = 0) const;
-  virtual void vector_value (const Point<dim> &p,
-							 Vector<double>   &value) const;
-};
+CellLocator<dim>::CellLocator (const Triangulation<dim> &triangulation,
+                               const unsigned int        n_buckets_per_direction)
+  :
+  triangulation (&triangulation),
+  n_buckets_per_direction (n_buckets_per_direction),
+  anchor_level (numbers::invalid_unsigned_int)
+{}
+
+
+
 template <int dim>
-double
-RightHandSide1<dim>::value (const Point<dim>  &p  ,
-						   const unsigned int /*component */) const
+void CellLocator<dim>::update ()
 {
-  return 0;
+  unsigned int min_active_level = numbers::invalid_unsigned_int;
+  for (typename Triangulation<dim>::active_cell_iterator
+       cell = triangulation->begin_active(); cell != triangulation->end(); ++cell)
+    min_active_level = std::min (min_active_level, static_cast<unsigned int>(cell->level()));
+
+  if (buckets.empty() || (min_active_level != anchor_level))
+    {
+      anchor_level = min_active_level;
+      rebuild ();
+    }
 }
+
+
+
 template <int dim>
-void
-RightHandSide1<dim>::vector_value (const Point<dim> &p,
-								  Vector<double>   &values) const
+void CellLocator<dim>::rebuild ()
 {
-  for (unsigned int c=0; c<this->n_components; ++c)
-	values(c) = RightHandSide1<dim>::value (p, c);
+  const std::vector<Point<dim> > &vertices = triangulation->get_vertices ();
+  const std::vector<bool>        &used     = triangulation->get_used_vertices ();
+
+  const unsigned int first_vertex = std::find (used.begin(), used.end(), true) - used.begin();
+  lower_corner = vertices[first_vertex];
+  Point<dim> upper_corner = vertices[first_vertex];
+  for (unsigned int v=first_vertex+1; v<vertices.size(); ++v)
+    if (used[v])
+      for (unsigned int d=0; d<dim; ++d)
+        {
+          lower_corner[d] = std::min (lower_corner[d], vertices[v][d]);
+          upper_corner[d] = std::max (upper_corner[d], vertices[v][d]);
+        }
+  for (unsigned int d=0; d<dim; ++d)
+    bucket_size[d] = (upper_corner[d] - lower_corner[d]) / n_buckets_per_direction;
+
+  buckets.clear ();
+  buckets.resize (Utilities::fixed_power<dim> (n_buckets_per_direction));
+
+  for (typename Triangulation<dim>::cell_iterator
+       cell = triangulation->begin (anchor_level); cell != triangulation->end (anchor_level); ++cell)
+    {
+      Point<dim> cell_lower = cell->vertex (0), cell_upper = cell->vertex (0);
+      for (unsigned int v=1; v<GeometryInfo<dim>::vertices_per_cell; ++v)
+        for (unsigned int d=0; d<dim; ++d)
+          {
+            cell_lower[d] = std::min (cell_lower[d], cell->vertex (v)[d]);
+            cell_upper[d] = std::max (cell_upper[d], cell->vertex (v)[d]);
+          }
+
+      unsigned int first_bucket[dim], last_bucket[dim];
+      for (unsigned int d=0; d<dim; ++d)
+        {
+          first_bucket[d] = std::min<unsigned int> (std::max (0., (cell_lower[d] - lower_corner[d]) / bucket_size[d]),
+                                                    n_buckets_per_direction - 1);
+          last_bucket[d]  = std::min<unsigned int> (std::max (0., (cell_upper[d] - lower_corner[d]) / bucket_size[d]),
+                                                    n_buckets_per_direction - 1);
+        }
+
+      // Visit all buckets from first_bucket to last_bucket, counting up
+      // the first direction fastest.
+      unsigned int b[dim];
+      std::copy (first_bucket, first_bucket+dim, b);
+      while (true)
+        {
+          unsigned int index = 0;
+          for (int d=dim-1; d>=0; --d)
+            index = index * n_buckets_per_direction + b[d];
+          buckets[index].push_back (cell);
+
+          unsigned int d = 0;
+          while ((d < dim) && (b[d] == last_bucket[d]))
+            {
+              b[d] = first_bucket[d];
+              ++d;
+            }
+          if (d == dim)
+            break;
+          ++b[d];
+        }
+    }
 }
 
 
+
 template <int dim>
-class BubbleGauss : public dealii::Function<dim> {
-public:
-  BubbleGauss(const double& amplitude = 1, const double& sigma = 5, const Point<dim>& center = Point<dim>());
+unsigned int CellLocator<dim>::bucket (const Point<dim> &point) const
+{
+  unsigned int index = 0;
+  for (int d=dim-1; d>=0; --d)
+    {
+      const double       position = std::max (0., (point[d] - lower_corner[d]) / bucket_size[d]);
+      const unsigned int b        = std::min<unsigned int> (position, n_buckets_per_direction - 1);
+      index = index * n_buckets_per_direction + b;
+    }
+  return index;
+}
+
+
+
+template <int dim>
+bool CellLocator<dim>::in_bounding_box (const typename Triangulation<dim>::cell_iterator &cell,
+                                        const Point<dim>                                 &point)
+{
+  const double tolerance = 1e-10 * cell->diameter ();
+  for (unsigned int d=0; d<dim; ++d)
+    {
+      double lower = cell->vertex (0)[d], upper = cell->vertex (0)[d];
+      for (unsigned int v=1; v<GeometryInfo<dim>::vertices_per_cell; ++v)
+        {
+          lower = std::min (lower, cell->vertex (v)[d]);
+          upper = std::max (upper, cell->vertex (v)[d]);
+        }
+      if ((point[d] < lower - tolerance) || (point[d] > upper + tolerance))
+        return false;
+    }
+  return true;
+}
+
+
+
+template <int dim>
+std::pair<typename Triangulation<dim>::active_cell_iterator, Point<dim> >
+CellLocator<dim>::locate (const Point<dim> &point) const
+{
+  Assert (!buckets.empty(), ExcMessage ("update() has to be called first."));
+
+  const std::vector<typename Triangulation<dim>::cell_iterator> &candidates = buckets[bucket (point)];
+  for (unsigned int c=0; c<candidates.size(); ++c)
+    if (in_bounding_box (candidates[c], point))
+      {
+        typename Triangulation<dim>::cell_iterator cell = candidates[c];
+        while (cell->has_children ())
+          {
+            unsigned int child = 0;
+            while ((child < cell->n_children()-1) && !in_bounding_box (cell->child (child), point))
+              ++child;
+            cell = cell->child (child);
+          }
+
+        try
+          {
+            const Point<dim> unit_point = mapping.transform_real_to_unit_cell (cell, point);
+            if (GeometryInfo<dim>::is_inside_unit_cell (unit_point, 1e-10))
+              return std::make_pair (typename Triangulation<dim>::active_cell_iterator (cell),
+                                     unit_point);
+          }
+        catch (const typename Mapping<dim>::ExcTransformationFailed &)
+          {}
+      }
+
+  // Cells with curved or non-parallel faces can make the bounding boxes
+  // miss; fall back to the global search.
+  return GridTools::find_active_cell_around_point (mapping, *triangulation, point);
+}
+
+
+
+template <int dim>
+void CellLocator<dim>::sample (const DoFHandler<dim>            &dof_handler,
+                               const Vector<double>             &solution,
+                               const std::vector<Point<dim> >   &points,
+                               std::vector<Vector<double> >     &values) const
+{
+  const FiniteElement<dim> &fe = dof_handler.get_fe();
+  std::vector<types::global_dof_index> dof_indices (fe.dofs_per_cell);
+
+  // Points are sorted by cell, so that the DoF indices of each cell are
+  // gathered only once.
+  std::vector<std::pair<std::pair<int, int>, unsigned int> > cell_of_point (points.size());
+  std::vector<Point<dim> >                                   unit_points (points.size());
+  for (unsigned int p=0; p<points.size(); ++p)
+    {
+      const std::pair<typename Triangulation<dim>::active_cell_iterator, Point<dim> >
+      cell_and_point = locate (points[p]);
+      cell_of_point[p] = std::make_pair (std::make_pair (cell_and_point.first->level(),
+                                                         cell_and_point.first->index()), p);
+      unit_points[p]   = cell_and_point.second;
+    }
+  std::sort (cell_of_point.begin(), cell_of_point.end());
+
+  values.resize (points.size());
+  for (unsigned int i=0; i<cell_of_point.size(); ++i)
+    {
+      if ((i == 0) || (cell_of_point[i].first != cell_of_point[i-1].first))
+        typename DoFHandler<dim>::active_cell_iterator (&dof_handler.get_tria(),
+                                                        cell_of_point[i].first.first,
+                                                        cell_of_point[i].first.second,
+                                                        &dof_handler)->get_dof_indices (dof_indices);
+
+      const unsigned int p = cell_of_point[i].second;
+      values[p].reinit (fe.n_components());
+      for (unsigned int j=0; j<fe.dofs_per_cell; ++j)
+        {
+          const unsigned int component = fe.system_to_component_index (j).first;
+          values[p](component) += fe.shape_value_component (j, unit_points[p], component)
+                                  * solution (dof_indices[j]);
+        }
+    }
+}
+
+
+/*
+ * In-situ analysis of the velocity field: values at probe points and along
+ * sample lines, the kinetic energy and the maximal velocity. For each point
+ * the surrounding cell (found with a CellLocator) and the shape function
+ * values there are looked up once and kept until invalidate() is called after the mesh changed, so
+ * that evaluating a point is one short sum over the cell's DoF values.
+ * Every call of evaluate() appends one line to the output file, which is
+ * not flushed.
+ */
+template <int dim>
+class InSituAnalysis
+{
+public:
+  InSituAnalysis ();
+
+  void add_probe (const Point<dim> &point);
+  void add_line (const Point<dim>   &start,
+                 const Point<dim>   &end,
+                 const unsigned int  n_points);
+
+  void open (const std::string &filename);
+  void invalidate ();
+  void evaluate (const DoFHandler<dim>   &dof_handler,
+                 const CellLocator<dim>  &locator,
+                 const Vector<double>    &solution,
+                 const double             time);
+
+private:
+  struct CachedPoint
+  {
+    std::vector<types::global_dof_index> dof_indices;
+    std::vector<unsigned int>            components;
+    std::vector<double>                  shape_values;
+  };
+
+  void build_lookup (const DoFHandler<dim>  &dof_handler,
+                     const CellLocator<dim> &locator);
+
+  std::vector<Point<dim> >  points;
+  std::vector<std::string>  labels;
+  unsigned int              n_lines;
+
+  std::vector<CachedPoint>  lookup;
+  bool                      lookup_up_to_date;
+
+  // Kept between calls, so that evaluate() does not allocate.
+  Quadrature<dim>                 quadrature_formula;
+  std::unique_ptr<FEValues<dim> > fe_values;
+  Vector<double>                  local_values;
+  Vector<double>                  nodal_speed_squared;
+
+  std::ofstream             out;
+};
+
+
+
+template <int dim>
+InSituAnalysis<dim>::InSituAnalysis ()
+  :
+  n_lines (0),
+  lookup_up_to_date (false)
+{}
+
+
+
+template <int dim>
+void InSituAnalysis<dim>::add_probe (const Point<dim> &point)
+{
+  points.push_back (point);
+  labels.push_back ("probe" + Utilities::int_to_string (labels.size()));
+  lookup_up_to_date = false;
+}
+
+
+
+template <int dim>
+void InSituAnalysis<dim>::add_line (const Point<dim>   &start,
+                                    const Point<dim>   &end,
+                                    const unsigned int  n_points)
+{
+  Assert (n_points > 1, ExcMessage ("A line sample needs at least two points."));
+  for (unsigned int i=0; i<n_points; ++i)
+    {
+      points.push_back (start + (end - start) * (double(i) / (n_points-1)));
+      labels.push_back ("line" + Utilities::int_to_string (n_lines)
+                        + "_" + Utilities::int_to_string (i));
+    }
+  ++n_lines;
+  lookup_up_to_date = false;
+}
+
+
+
+template <int dim>
+void InSituAnalysis<dim>::open (const std::string &filename)
+{
+  out.open (filename.c_str());
+  AssertThrow (out, ExcIO());
+
+  out << "# time  kinetic_energy  max_velocity";
+  for (unsigned int p=0; p<points.size(); ++p)
+    for (unsigned int d=0; d<dim; ++d)
+      out << "  " << labels[p] << "_u" << d;
+  out << '\n';
+}
+
+
+
+template <int dim>
+void InSituAnalysis<dim>::invalidate ()
+{
+  lookup_up_to_date = false;
+}
+
+
+
+template <int dim>
+void InSituAnalysis<dim>::build_lookup (const DoFHandler<dim>  &dof_handler,
+                                        const CellLocator<dim> &locator)
+{
+  const FiniteElement<dim> &fe            = dof_handler.get_fe();
+  const unsigned int        dofs_per_cell = fe.dofs_per_cell;
+
+  lookup.resize (points.size());
+  for (unsigned int p=0; p<points.size(); ++p)
+    {
+      const std::pair<typename Triangulation<dim>::active_cell_iterator, Point<dim> >
+      cell_and_point = locator.locate (points[p]);
+
+      CachedPoint &cached = lookup[p];
+      cached.dof_indices.resize (dofs_per_cell);
+      cached.components.resize (dofs_per_cell);
+      cached.shape_values.resize (dofs_per_cell);
+
+      typename DoFHandler<dim>::active_cell_iterator (&dof_handler.get_tria(),
+                                                      cell_and_point.first->level(),
+                                                      cell_and_point.first->index(),
+                                                      &dof_handler)->get_dof_indices (cached.dof_indices);
+      for (unsigned int i=0; i<dofs_per_cell; ++i)
+        {
+          cached.components[i]   = fe.system_to_component_index (i).first;
+          cached.shape_values[i] = fe.shape_value_component (i, cell_and_point.second,
+                                                             cached.components[i]);
+        }
+    }
+
+  lookup_up_to_date = true;
+}
+
+
+
+template <int dim>
+void InSituAnalysis<dim>::evaluate (const DoFHandler<dim>   &dof_handler,
+                                    const CellLocator<dim>  &locator,
+                                    const Vector<double>    &solution,
+                                    const double             time)
+{
+  if (!out.is_open())
+    return;
+
+  if (!lookup_up_to_date)
+    build_lookup (dof_handler, locator);
+
+  // Kinetic energy by Gauss quadrature with degree+1 points per direction,
+  // exact for |u|^2 on affine cells. The maximal velocity is the maximum of
+  // |u| over the support points. For Q1 elements |u| is convex along every
+  // coordinate direction of a cell, so this is the exact maximum; for
+  // higher degrees it is a lower bound.
+  const FiniteElement<dim> &fe = dof_handler.get_fe();
+  if (!fe_values)
+    {
+      quadrature_formula = QGauss<dim> (fe.degree + 1);
+      fe_values.reset (new FEValues<dim> (fe, quadrature_formula,
+                                          update_values | update_JxW_values));
+      local_values.reinit (fe.dofs_per_cell);
+      nodal_speed_squared.reinit (fe.base_element(0).dofs_per_cell);
+    }
+
+  double kinetic_energy = 0;
+  double max_velocity   = 0;
+
+  typename DoFHandler<dim>::active_cell_iterator
+  cell = dof_handler.begin_active(),
+  endc = dof_handler.end();
+  for (; cell!=endc; ++cell)
+    {
+      fe_values->reinit (cell);
+      cell->get_dof_values (solution, local_values);
+      for (unsigned int q=0; q<quadrature_formula.size(); ++q)
+        {
+          Tensor<1, dim> u;
+          for (unsigned int i=0; i<fe.dofs_per_cell; ++i)
+            u[fe.system_to_component_index (i).first] += local_values(i) * fe_values->shape_value (i, q);
+          kinetic_energy += 0.5 * (u * u) * fe_values->JxW (q);
+        }
+
+      nodal_speed_squared = 0;
+      for (unsigned int i=0; i<fe.dofs_per_cell; ++i)
+        nodal_speed_squared(fe.system_to_base_index (i).second) += local_values(i) * local_values(i);
+      max_velocity = std::max (max_velocity, nodal_speed_squared.linfty_norm ());
+    }
+  max_velocity = std::sqrt (max_velocity);
+
+  out << time << "  " << kinetic_energy << "  " << max_velocity;
+  for (unsigned int p=0; p<points.size(); ++p)
+    {
+      Tensor<1, dim> u;
+      const CachedPoint &cached = lookup[p];
+      for (unsigned int i=0; i<cached.dof_indices.size(); ++i)
+        u[cached.components[i]] += cached.shape_values[i] * solution (cached.dof_indices[i]);
+      for (unsigned int d=0; d<dim; ++d)
+        out << "  " << u[d];
+    }
+  out << '\n';
+}
+
+
+
+/*
+ * Stabilization terms that can be added to the cell matrix and right hand
+ * side of the implicit Euler system M u + dt N(u*) u = M u^n + dt f, which
+ * is scaled by the time step. Any combination of
+ *
+ *  - SUPG: tau_K (R(u), (u*.grad) v) with the strong residual
+ *    R(u) = u + dt (u*.grad) u - u^n - dt f (the viscous part vanishes for
+ *    Q1), which already carries the factor dt of the system, and
+ *    tau_K = ((2/dt)^2 + (2|u*|/h)^2 + (4 nu/h^2)^2)^{-1/2}, a time,
+ *  - entropy viscosity: dt nu_K (grad u, grad v) with
+ *    nu_K = min (c_max h |u*|, c_E h^2 |R_E| / |E|), where R_E is the
+ *    residual of the entropy E = |u|^2/2 computed from u^n and u^{n-1},
+ *  - grad-div: dt gamma_K (div u, div v) with gamma_K = c_gd h |u*|
+ *
+ * can be selected with the bits of terms, e.g. from a list of names with
+ * parse_terms(). The grad-div term is not
+ * consistent for the compressible Burgers velocity and is scaled with h so
+ * that it vanishes under refinement. reinit() computes the cell parameters
+ * before the add_* functions are called for a cell.
+ */
+template <int dim>
+class Stabilization
+{
+public:
+  enum Term
+  {
+    none              = 0,
+    supg              = 1,
+    entropy_viscosity = 2,
+    grad_div          = 4
+  };
+
+  Stabilization ();
+
+  // Bits of terms from a comma separated list of the names none, supg,
+  // entropy_viscosity and grad_div.
+  static unsigned int parse_terms (const std::string &names);
+
+  bool active () const;
+  bool needs_entropy_residual () const;
+
+  void reinit (const double                        h,
+               const double                        nu,
+               const double                        time_step,
+               const std::vector<Tensor<1, dim> > &u_star,
+               const std::vector<double>          &entropy_residual,
+               const double                        entropy_normalization);
+
+  void add_cell_matrix (const FEValuesViews::Vector<dim>   &fe_vector_values,
+                        const FEValues<dim>                &fe_values,
+                        const std::vector<Tensor<1, dim> > &u_star,
+                        const double                        time_step,
+                        FullMatrix<double>                 &cell_matrix) const;
+
+  void add_cell_rhs (const FEValuesViews::Vector<dim>   &fe_vector_values,
+                     const FEValues<dim>                &fe_values,
+                     const std::vector<Tensor<1, dim> > &u_star,
+                     const std::vector<Tensor<1, dim> > &history,
+                     Vector<double>                     &cell_rhs) const;
+
+  unsigned int terms;
+  double       c_max;
+  double       c_entropy;
+  double       c_grad_div;
+
+private:
+  static Tensor<1, dim> directional_derivative (const Tensor<2, dim> &gradient,
+                                                const Tensor<1, dim> &direction);
+
+  double tau;
+  double artificial_viscosity;
+  double grad_div_parameter;
+};
+
+
+
+template <int dim>
+Stabilization<dim>::Stabilization ()
+  :
+  terms (none),
+  c_max (0.1),
+  c_entropy (1.0),
+  c_grad_div (0.1),
+  tau (0),
+  artificial_viscosity (0),
+  grad_div_parameter (0)
+{}
+
+
+
+template <int dim>
+unsigned int Stabilization<dim>::parse_terms (const std::string &names)
+{
+  unsigned int terms = none;
+  const std::vector<std::string> list = Utilities::split_string_list (names, ',');
+  for (unsigned int i=0; i<list.size(); ++i)
+    if (list[i] == "supg")
+      terms |= supg;
+    else if (list[i] == "entropy_viscosity")
+      terms |= entropy_viscosity;
+    else if (list[i] == "grad_div")
+      terms |= grad_div;
+    else
+      AssertThrow (list[i] == "none",
+                   ExcMessage ("Unknown stabilization term " + list[i]));
+  return terms;
+}
+
+
+
+template <int dim>
+bool Stabilization<dim>::active () const
+{
+  return (terms != none);
+}
+
+
+
+template <int dim>
+bool Stabilization<dim>::needs_entropy_residual () const
+{
+  return (terms & entropy_viscosity);
+}
+
+
+
+template <int dim>
+Tensor<1, dim>
+Stabilization<dim>::directional_derivative (const Tensor<2, dim> &gradient,
+                                            const Tensor<1, dim> &direction)
+{
+  Tensor<1, dim> result;
+  for (unsigned int c=0; c<dim; ++c)
+    for (unsigned int d=0; d<dim; ++d)
+      result[c] += gradient[c][d] * direction[d];
+  return result;
+}
+
+
+
+template <int dim>
+void Stabilization<dim>::reinit (const double                        h,
+                                 const double                        nu,
+                                 const double                        time_step,
+                                 const std::vector<Tensor<1, dim> > &u_star,
+                                 const std::vector<double>          &entropy_residual,
+                                 const double                        entropy_normalization)
+{
+  double u_max = 0;
+  for (unsigned int q=0; q<u_star.size(); ++q)
+    u_max = std::max (u_max, u_star[q].norm());
+
+  tau = 0;
+  if (terms & supg)
+    tau = 1. / std::sqrt (std::pow (2. / time_step, 2) +
+                          std::pow (2. * u_max / h, 2) +
+                          std::pow (4. * nu / (h * h), 2));
+
+  artificial_viscosity = 0;
+  if (terms & entropy_viscosity)
+    {
+      double residual_max = 0;
+      for (unsigned int q=0; q<entropy_residual.size(); ++q)
+        residual_max = std::max (residual_max, std::fabs (entropy_residual[q]));
+      artificial_viscosity = std::min (c_max * h * u_max,
+                                       c_entropy * h * h * residual_max / entropy_normalization);
+    }
+
+  grad_div_parameter = 0;
+  if (terms & grad_div)
+    grad_div_parameter = c_grad_div * h * u_max;
+}
+
+
+
+template <int dim>
+void Stabilization<dim>::add_cell_matrix (const FEValuesViews::Vector<dim>   &fe_vector_values,
+                                          const FEValues<dim>                &fe_values,
+                                          const std::vector<Tensor<1, dim> > &u_star,
+                                          const double                        time_step,
+                                          FullMatrix<double>                 &cell_matrix) const
+{
+  const unsigned int dofs_per_cell = cell_matrix.m();
+
+  for (unsigned int q_index=0; q_index<u_star.size(); ++q_index)
+    {
+      const double JxW = fe_values.JxW (q_index);
+      for (unsigned int i=0; i<dofs_per_cell; ++i)
+        {
+          const Tensor<2, dim> &v_grad       = fe_vector_values.gradient (i, q_index);
+          const Tensor<1, dim>  v_streamline = directional_derivative (v_grad, u_star[q_index]);
+          const double          v_div        = fe_vector_values.divergence (i, q_index);
+
+          for (unsigned int j=0; j<dofs_per_cell; ++j)
+            {
+              const Tensor<2, dim> &u_grad = fe_vector_values.gradient (j, q_index);
+              const Tensor<1, dim>  u_residual = fe_vector_values.value (j, q_index)
+                                                 + time_step * directional_derivative (u_grad, u_star[q_index]);
+
+              cell_matrix(i,j) += ( tau * (u_residual * v_streamline)
+                                    +
+                                    time_step * artificial_viscosity * double_contract (u_grad, v_grad)
+                                    +
+                                    time_step * grad_div_parameter * fe_vector_values.divergence (j, q_index) * v_div
+                                  ) * JxW;
+            }
+        }
+    }
+}
+
+
+
+template <int dim>
+void Stabilization<dim>::add_cell_rhs (const FEValuesViews::Vector<dim>   &fe_vector_values,
+                                       const FEValues<dim>                &fe_values,
+                                       const std::vector<Tensor<1, dim> > &u_star,
+                                       const std::vector<Tensor<1, dim> > &history,
+                                       Vector<double>                     &cell_rhs) const
+{
+  if (tau == 0)
+    return;
+
+  for (unsigned int q_index=0; q_index<u_star.size(); ++q_index)
+    for (unsigned int i=0; i<cell_rhs.size(); ++i)
+      cell_rhs(i) += tau * (history[q_index] *
+                            directional_derivative (fe_vector_values.gradient (i, q_index), u_star[q_index]))
+                     * fe_values.JxW (q_index);
+}
+
+
+
+/*
+ * Restarted GMRES with a single global reduction per Arnoldi step.
+ *
+ * The classical GMRES in deal.II orthogonalizes the new Krylov vector with
+ * modified Gram-Schmidt, i.e. one dot product (one sweep over memory and,
+ * once threaded or distributed, one synchronization) per basis vector.
+ * Here all inner products <v_i,w> and the norm <w,w> are computed in one
+ * fused sweep over w (classical Gram-Schmidt), and the norm of the
+ * orthogonalized vector is recovered from the Pythagorean identity
+ * |w - V h|^2 = |w|^2 - |h|^2. The vector update and the normalization
+ * of the next basis vector are fused into a second sweep. If the identity
+ * suffers from cancellation, a second Gram-Schmidt pass is done.
+ *
+ * The preconditioner is applied from the right, so that the residual
+ * handed to the SolverControl is the true residual like in the
+ * SolverGMRES<> used before.
+ *
+ * All vectors and small arrays live in a Workspace. A workspace that
+ * outlives the solver object, like the one Burger keeps, makes repeated
+ * solves of the same size free of heap allocations.
+ */
+class SolverFusedGMRES
+{
+public:
+  struct AdditionalData
+  {
+    AdditionalData (const unsigned int max_basis_size = 30)
+      :
+      max_basis_size (max_basis_size)
+    {}
+
+    unsigned int max_basis_size;
+  };
+
+  struct Workspace
+  {
+    std::vector<Vector<double> >      basis;
+    Vector<double>                    r, z;
+    std::vector<std::vector<double> > H;
+    std::vector<double>               cs, sn, g, h, h2, y;
+  };
+
+  SolverFusedGMRES (SolverControl        &solver_control,
+                    const AdditionalData &data = AdditionalData())
+    :
+    solver_control (solver_control),
+    additional_data (data),
+    workspace (own_workspace)
+  {}
+
+  SolverFusedGMRES (SolverControl        &solver_control,
+                    Workspace            &workspace,
+                    const AdditionalData &data = AdditionalData())
+    :
+    solver_control (solver_control),
+    additional_data (data),
+    workspace (workspace)
+  {}
+
+  template <class MatrixType, class PreconditionerType>
+  void solve (const MatrixType         &A,
+              Vector<double>           &x,
+              const Vector<double>     &b,
+              const PreconditionerType &preconditioner);
+
+private:
+  void fused_dot_products (const unsigned int    n_basis,
+                           const Vector<double> &w,
+                           std::vector<double>  &h,
+                           double               &w_norm_square) const;
+
+  void fused_update (const unsigned int         n_basis,
+                     const std::vector<double> &h,
+                     const double               scaling,
+                     Vector<double>            &w) const;
+
+  SolverControl              &solver_control;
+  const AdditionalData        additional_data;
+
+  Workspace                   own_workspace;
+  Workspace                  &workspace;
+};
+
+
+
+void SolverFusedGMRES::fused_dot_products (const unsigned int    n_basis,
+                                           const Vector<double> &w,
+                                           std::vector<double>  &h,
+                                           double               &w_norm_square) const
+{
+  // Walk through the vectors in chunks that fit into cache, so that w is
+  // read from main memory only once for all n_basis+1 reductions.
+  const unsigned int chunk_size = 512;
+  const unsigned int size       = w.size();
+
+  std::fill (h.begin(), h.begin() + n_basis, 0.);
+  w_norm_square = 0;
+
+  for (unsigned int begin = 0; begin < size; begin += chunk_size)
+    {
+      const unsigned int end = std::min (begin + chunk_size, size);
+
+      double norm_part = 0;
+      for (unsigned int k = begin; k < end; ++k)
+        norm_part += w(k) * w(k);
+      w_norm_square += norm_part;
+
+      for (unsigned int i = 0; i < n_basis; ++i)
+        {
+          const Vector<double> &v = workspace.basis[i];
+          double dot_part = 0;
+          for (unsigned int k = begin; k < end; ++k)
+            dot_part += v(k) * w(k);
+          h[i] += dot_part;
+        }
+    }
+}
+
+
+
+void SolverFusedGMRES::fused_update (const unsigned int         n_basis,
+                                     const std::vector<double> &h,
+                                     const double               scaling,
+                                     Vector<double>            &w) const
+{
+  const unsigned int chunk_size = 512;
+  const unsigned int size       = w.size();
+
+  for (unsigned int begin = 0; begin < size; begin += chunk_size)
+    {
+      const unsigned int end = std::min (begin + chunk_size, size);
+
+      for (unsigned int i = 0; i < n_basis; ++i)
+        {
+          const Vector<double> &v = workspace.basis[i];
+          const double          h_i = h[i];
+          for (unsigned int k = begin; k < end; ++k)
+            w(k) -= h_i * v(k);
+        }
+
+      if (scaling != 1.)
+        for (unsigned int k = begin; k < end; ++k)
+          w(k) *= scaling;
+    }
+}
+
+
+
+template <class MatrixType, class PreconditionerType>
+void SolverFusedGMRES::solve (const MatrixType         &A,
+                              Vector<double>           &x,
+                              const Vector<double>     &b,
+                              const PreconditionerType &preconditioner)
+{
+  const unsigned int m = additional_data.max_basis_size;
+
+  // Resizing keeps the memory of a workspace that has been used for a
+  // system of the same or larger size before.
+  std::vector<Vector<double> > &basis = workspace.basis;
+  basis.resize (m + 1);
+  for (unsigned int i = 0; i < m + 1; ++i)
+    basis[i].reinit (x.size(), true);
+
+  Vector<double> &r = workspace.r;
+  Vector<double> &z = workspace.z;
+  r.reinit (x.size(), true);
+  z.reinit (x.size(), true);
+
+  // Hessenberg matrix stored column by column, Givens rotations and the
+  // right hand side of the small least squares problem.
+  std::vector<std::vector<double> > &H = workspace.H;
+  H.resize (m);
+  for (unsigned int i = 0; i < m; ++i)
+    H[i].resize (m + 1);
+  std::vector<double> &cs = workspace.cs, &sn = workspace.sn, &g = workspace.g,
+                      &h  = workspace.h,  &h2 = workspace.h2, &y = workspace.y;
+  cs.resize (m);
+  sn.resize (m);
+  g.resize (m + 1);
+  h.resize (m + 1);
+  h2.resize (m + 1);
+  y.resize (m);
+
+  A.vmult (r, x);
+  r.sadd (-1., 1., b);
+  double beta = r.l2_norm ();
+
+  unsigned int step = 0;
+  SolverControl::State state = solver_control.check (step, beta);
+
+  while (state == SolverControl::iterate)
+    {
+      basis[0].equ (1. / beta, r);
+      std::fill (g.begin(), g.end(), 0.);
+      g[0] = beta;
+
+      unsigned int j = 0;
+      for (; j < m && state == SolverControl::iterate; ++j)
+        {
+          preconditioner.vmult (z, basis[j]);
+          A.vmult (basis[j + 1], z);
+
+          double w_norm_square;
+          fused_dot_products (j + 1, basis[j + 1], h, w_norm_square);
+
+          double h_norm_square = 0;
+          for (unsigned int i = 0; i <= j; ++i)
+            h_norm_square += h[i] * h[i];
+          double new_norm_square = w_norm_square - h_norm_square;
+
+          // Without cancellation, subtract the projection and normalize in
+          // one sweep. Otherwise orthogonalize once, and do a second
+          // classical Gram-Schmidt pass whose norm is safe to use.
+          const std::vector<double> *correction = &h;
+          if (new_norm_square < 1e-2 * w_norm_square)
+            {
+              fused_update (j + 1, h, 1., basis[j + 1]);
+              fused_dot_products (j + 1, basis[j + 1], h2, w_norm_square);
+              new_norm_square = w_norm_square;
+              for (unsigned int i = 0; i <= j; ++i)
+                {
+                  new_norm_square -= h2[i] * h2[i];
+                  h[i] += h2[i];
+                }
+              correction = &h2;
+            }
+
+          const double h_next = std::sqrt (std::max (new_norm_square, 0.));
+          fused_update (j + 1, *correction, (h_next > 0 ? 1. / h_next : 1.),
+                        basis[j + 1]);
+
+          for (unsigned int i = 0; i <= j; ++i)
+            H[j][i] = h[i];
+          H[j][j + 1] = h_next;
+
+          for (unsigned int i = 0; i < j; ++i)
+            {
+              const double tmp =  cs[i] * H[j][i] + sn[i] * H[j][i + 1];
+              H[j][i + 1]      = -sn[i] * H[j][i] + cs[i] * H[j][i + 1];
+              H[j][i]          = tmp;
+            }
+          const double denominator = std::sqrt (H[j][j] * H[j][j] + h_next * h_next);
+          cs[j] = H[j][j] / denominator;
+          sn[j] = h_next  / denominator;
+          H[j][j]     = denominator;
+          H[j][j + 1] = 0;
+          g[j + 1] = -sn[j] * g[j];
+          g[j]     =  cs[j] * g[j];
+
+          ++step;
+          state = solver_control.check (step, std::fabs (g[j + 1]));
+          if (h_next == 0)
+            {
+              ++j;
+              break;
+            }
+        }
+
+      // Back substitution and update x += P V y.
+      for (int i = j - 1; i >= 0; --i)
+        {
+          double sum = g[i];
+          for (unsigned int k = i + 1; k < j; ++k)
+            sum -= H[k][i] * y[k];
+          y[i] = sum / H[i][i];
+        }
+
+      r = 0;
+      for (unsigned int i = 0; i < j; ++i)
+        r.add (y[i], basis[i]);
+      preconditioner.vmult (z, r);
+      x += z;
+
+      A.vmult (r, x);
+      r.sadd (-1., 1., b);
+      beta = r.l2_norm ();
+
+      if (state == SolverControl::iterate)
+        state = solver_control.check (step, beta);
+    }
+
+  AssertThrow (state == SolverControl::success,
+               SolverControl::NoConvergence (solver_control.last_step(),
+                                             solver_control.last_value()));
+}
+
+
+
+/*
+ * Restarted GMRES that recycles a subspace between consecutive solves
+ * (GCRO with deflation, in the spirit of GCRO-DR).
+ *
+ * The solver keeps a set of directions U between calls. At the start of
+ * every solve, C = A U is recomputed for the current matrix and
+ * orthonormalized, the initial residual is projected onto the complement
+ * of range(C), and the Arnoldi process works on (I - C C^T) A P. The
+ * directions in which the previous solves converged slowly are thereby
+ * removed from the spectrum the Krylov method sees.
+ *
+ * After each solve, the right singular vectors belonging to the smallest
+ * singular values of the last Hessenberg matrix (computed with a small
+ * Jacobi eigenvalue solver on H^T H) are mapped back to the solution space
+ * and added to U. This takes the place of the harmonic Ritz vectors of
+ * GCRO-DR, which would require a nonsymmetric generalized eigensolver.
+ *
+ * The recycled directions belong to a fixed set of degrees of freedom.
+ * When the mesh changes they have to be interpolated to the new mesh, as
+ * Burger::refine_grid() does, or cleared; since C and the projection are
+ * recomputed in every solve, interpolated directions are valid input.
+ */
+class SolverRecyclingGMRES
+{
+public:
+  struct AdditionalData
+  {
+    AdditionalData (const unsigned int max_basis_size   = 30,
+                    const unsigned int max_recycle_size = 10)
+      :
+      max_basis_size (max_basis_size),
+      max_recycle_size (max_recycle_size)
+    {}
+
+    unsigned int max_basis_size;
+    unsigned int max_recycle_size;
+  };
+
+  typedef std::vector<Vector<double> > RecycleSpace;
+
+  SolverRecyclingGMRES (SolverControl        &solver_control,
+                        RecycleSpace         &recycle_space,
+                        const AdditionalData &data = AdditionalData())
+    :
+    solver_control (solver_control),
+    recycle_space (recycle_space),
+    additional_data (data)
+  {}
+
+  template <class MatrixType, class PreconditionerType>
+  void solve (const MatrixType         &A,
+              Vector<double>           &x,
+              const Vector<double>     &b,
+              const PreconditionerType &preconditioner);
+
+private:
+  static void
+  smallest_eigenvectors (std::vector<std::vector<double> > &S,
+                         const unsigned int                 n_vectors,
+                         std::vector<std::vector<double> > &eigenvectors);
+
+  SolverControl        &solver_control;
+  RecycleSpace         &recycle_space;
+  const AdditionalData  additional_data;
+};
+
+
+
+void
+SolverRecyclingGMRES::smallest_eigenvectors (std::vector<std::vector<double> > &S,
+                                             const unsigned int                 n_vectors,
+                                             std::vector<std::vector<double> > &eigenvectors)
+{
+  // Cyclic Jacobi method for the symmetric matrix S. The matrices here are
+  // at most max_basis_size x max_basis_size, so cost does not matter.
+  const unsigned int n = S.size();
+  std::vector<std::vector<double> > Q (n, std::vector<double> (n, 0.));
+  for (unsigned int i = 0; i < n; ++i)
+    Q[i][i] = 1.;
+
+  double norm = 0;
+  for (unsigned int i = 0; i < n; ++i)
+    for (unsigned int j = 0; j < n; ++j)
+      norm += S[i][j] * S[i][j];
+
+  for (unsigned int sweep = 0; sweep < 50; ++sweep)
+    {
+      double off_diagonal = 0;
+      for (unsigned int p = 0; p < n; ++p)
+        for (unsigned int q = p + 1; q < n; ++q)
+          off_diagonal += S[p][q] * S[p][q];
+      if (off_diagonal <= 1e-24 * norm)
+        break;
+
+      for (unsigned int p = 0; p < n; ++p)
+        for (unsigned int q = p + 1; q < n; ++q)
+          {
+            if (S[p][q] == 0)
+              continue;
+
+            const double theta = (S[q][q] - S[p][p]) / (2. * S[p][q]);
+            const double t = (theta >= 0 ? 1. : -1.) /
+                             (std::fabs (theta) + std::sqrt (theta * theta + 1.));
+            const double c = 1. / std::sqrt (t * t + 1.);
+            const double s = t * c;
+
+            for (unsigned int k = 0; k < n; ++k)
+              {
+                const double s_kp = S[k][p], s_kq = S[k][q];
+                S[k][p] = c * s_kp - s * s_kq;
+                S[k][q] = s * s_kp + c * s_kq;
+              }
+            for (unsigned int k = 0; k < n; ++k)
+              {
+                const double s_pk = S[p][k], s_qk = S[q][k];
+                S[p][k] = c * s_pk - s * s_qk;
+                S[q][k] = s * s_pk + c * s_qk;
+              }
+            for (unsigned int k = 0; k < n; ++k)
+              {
+                const double q_kp = Q[k][p], q_kq = Q[k][q];
+                Q[k][p] = c * q_kp - s * q_kq;
+                Q[k][q] = s * q_kp + c * q_kq;
+              }
+          }
+    }
+
+  std::vector<std::pair<double, unsigned int> > eigenvalues (n);
+  for (unsigned int i = 0; i < n; ++i)
+    eigenvalues[i] = std::make_pair (S[i][i], i);
+  std::sort (eigenvalues.begin(), eigenvalues.end());
+
+  eigenvectors.resize (std::min (n_vectors, n));
+  for (unsigned int v = 0; v < eigenvectors.size(); ++v)
+    {
+      eigenvectors[v].resize (n);
+      for (unsigned int k = 0; k < n; ++k)
+        eigenvectors[v][k] = Q[k][eigenvalues[v].second];
+    }
+}
+
+
+
+template <class MatrixType, class PreconditionerType>
+void SolverRecyclingGMRES::solve (const MatrixType         &A,
+                                  Vector<double>           &x,
+                                  const Vector<double>     &b,
+                                  const PreconditionerType &preconditioner)
+{
+  const unsigned int m = additional_data.max_basis_size;
+  const unsigned int n = x.size();
+
+  // Recompute C = A U for the current matrix and orthonormalize it,
+  // applying the same transformation to U so that A U = C still holds.
+  // Directions that became linearly dependent are dropped.
+  std::vector<Vector<double> > C;
+  {
+    RecycleSpace U;
+    for (unsigned int i = 0; i < recycle_space.size(); ++i)
+      {
+        if (recycle_space[i].size() != n)
+          continue;
+
+        Vector<double> c (n);
+        Vector<double> u (recycle_space[i]);
+        A.vmult (c, u);
+
+        const double initial_norm = c.l2_norm ();
+        for (unsigned int j = 0; j < C.size(); ++j)
+          {
+            const double r = C[j] * c;
+            c.add (-r, C[j]);
+            u.add (-r, U[j]);
+          }
+        const double r = c.l2_norm ();
+        if ((initial_norm > 0) && (r > 1e-10 * initial_norm))
+          {
+            c /= r;
+            u /= r;
+            C.push_back (c);
+            U.push_back (u);
+          }
+      }
+    recycle_space.swap (U);
+  }
+  const unsigned int k = C.size();
+
+  Vector<double> r (n), z (n), w (n);
+  A.vmult (r, x);
+  r.sadd (-1., 1., b);
+  for (unsigned int i = 0; i < k; ++i)
+    {
+      const double alpha = C[i] * r;
+      x.add (alpha, recycle_space[i]);
+      r.add (-alpha, C[i]);
+    }
+  double beta = r.l2_norm ();
+
+  unsigned int step = 0;
+  SolverControl::State state = solver_control.check (step, beta);
+
+  std::vector<Vector<double> > V (m + 1, Vector<double> (n));
+  // H holds the rotated Hessenberg matrix column by column, H_bar the
+  // unrotated one that is needed to select the new recycled directions,
+  // and B = C^T A P V.
+  std::vector<std::vector<double> > H (m, std::vector<double> (m + 1));
+  std::vector<std::vector<double> > H_bar (m, std::vector<double> (m + 1));
+  std::vector<std::vector<double> > B (k, std::vector<double> (m));
+  std::vector<double> cs (m), sn (m), g (m + 1), y (m);
+
+  unsigned int last_cycle_size = 0;
+
+  while (state == SolverControl::iterate)
+    {
+      V[0].equ (1. / beta, r);
+      std::fill (g.begin(), g.end(), 0.);
+      g[0] = beta;
+
+      unsigned int j = 0;
+      for (; j < m && state == SolverControl::iterate; ++j)
+        {
+          preconditioner.vmult (z, V[j]);
+          A.vmult (w, z);
+
+          for (unsigned int i = 0; i < k; ++i)
+            {
+              B[i][j] = C[i] * w;
+              w.add (-B[i][j], C[i]);
+            }
+          for (unsigned int i = 0; i <= j; ++i)
+            {
+              H[j][i] = V[i] * w;
+              w.add (-H[j][i], V[i]);
+            }
+          const double h_next = w.l2_norm ();
+          H[j][j + 1] = h_next;
+          if (h_next > 0)
+            V[j + 1].equ (1. / h_next, w);
+
+          for (unsigned int i = 0; i <= j + 1; ++i)
+            H_bar[j][i] = H[j][i];
+
+          for (unsigned int i = 0; i < j; ++i)
+            {
+              const double tmp =  cs[i] * H[j][i] + sn[i] * H[j][i + 1];
+              H[j][i + 1]      = -sn[i] * H[j][i] + cs[i] * H[j][i + 1];
+              H[j][i]          = tmp;
+            }
+          const double denominator = std::sqrt (H[j][j] * H[j][j] + h_next * h_next);
+          cs[j] = H[j][j] / denominator;
+          sn[j] = h_next  / denominator;
+          H[j][j]     = denominator;
+          H[j][j + 1] = 0;
+          g[j + 1] = -sn[j] * g[j];
+          g[j]     =  cs[j] * g[j];
+
+          ++step;
+          state = solver_control.check (step, std::fabs (g[j + 1]));
+          if (h_next == 0)
+            {
+              ++j;
+              break;
+            }
+        }
+
+      for (int i = j - 1; i >= 0; --i)
+        {
+          double sum = g[i];
+          for (unsigned int l = i + 1; l < j; ++l)
+            sum -= H[l][i] * y[l];
+          y[i] = sum / H[i][i];
+        }
+
+      // x += P V y - U B y
+      w = 0;
+      for (unsigned int i = 0; i < j; ++i)
+        w.add (y[i], V[i]);
+      preconditioner.vmult (z, w);
+      x += z;
+      for (unsigned int i = 0; i < k; ++i)
+        {
+          double by = 0;
+          for (unsigned int l = 0; l < j; ++l)
+            by += B[i][l] * y[l];
+          x.add (-by, recycle_space[i]);
+        }
+      last_cycle_size = j;
+
+      A.vmult (r, x);
+      r.sadd (-1., 1., b);
+      beta = r.l2_norm ();
+
+      if (state == SolverControl::iterate)
+        state = solver_control.check (step, beta);
+    }
+
+  // Add the directions belonging to the smallest singular values of the
+  // last H_bar, u = P V s - U B s, in front of the old recycled space.
+  if (last_cycle_size > 1)
+    {
+      const unsigned int j = last_cycle_size;
+      std::vector<std::vector<double> > HtH (j, std::vector<double> (j, 0.));
+      for (unsigned int a = 0; a < j; ++a)
+        for (unsigned int c = 0; c < j; ++c)
+          for (unsigned int i = 0; i <= std::min (a, c) + 1; ++i)
+            HtH[a][c] += H_bar[a][i] * H_bar[c][i];
+
+      std::vector<std::vector<double> > s;
+      smallest_eigenvectors (HtH,
+                             std::min (additional_data.max_recycle_size / 2 + 1, j - 1),
+                             s);
+
+      RecycleSpace new_space;
+      for (unsigned int v = 0; v < s.size(); ++v)
+        {
+          w = 0;
+          for (unsigned int i = 0; i < j; ++i)
+            w.add (s[v][i], V[i]);
+          preconditioner.vmult (z, w);
+          for (unsigned int i = 0; i < k; ++i)
+            {
+              double bs = 0;
+              for (unsigned int l = 0; l < j; ++l)
+                bs += B[i][l] * s[v][l];
+              z.add (-bs, recycle_space[i]);
+            }
+          new_space.push_back (z);
+        }
+      for (unsigned int i = 0;
+           (i < recycle_space.size()) && (new_space.size() < additional_data.max_recycle_size);
+           ++i)
+        new_space.push_back (recycle_space[i]);
+      recycle_space.swap (new_space);
+    }
+
+  AssertThrow (state == SolverControl::success,
+               SolverControl::NoConvergence (solver_control.last_step(),
+                                             solver_control.last_value()));
+}
+
+
+
+template <int dim>
+class Burger
+{
+public:
+  Burger (const unsigned int n_global_refinements = 3,
+          const unsigned int fe_degree            = 1);
+  ~Burger();
+  void run ();
+  void run_steady (const unsigned int n_adaptive_refinement_steps = 4);
+  // Time steps up to final_time on the uniform initial mesh, without
+  // pre-refinement, remeshing or output, so that runs with different time
+  // steps differ in the time discretization only. Returns the total number
+  // of linear iterations. The explicit scheme uses its own time step.
+  unsigned int run_fixed_mesh (const double final_time);
+  void print_memory_report ();
+
+  // Settings for unattended runs, e.g. several at once in a convergence
+  // study: the time step, a prefix for all output files and whether
+  // progress is printed.
+  void set_time_step (const double time_step);
+  void set_output_prefix (const std::string &prefix);
+  void set_verbose (const bool verbose);
+
+  // Solve every system with all linear solvers and print their iteration
+  // counts and wall times; only the selected solver's result is kept.
+  void set_compare_linear_solvers (const bool compare);
+
+  // Stabilization of the implicit Euler system, as the bits of
+  // Stabilization<dim>::Term.
+  void set_stabilization (const unsigned int terms);
+
+  // Run-time selection of the numerical methods, given as name=value on
+  // the command line; see the definition for the names. Throws for an
+  // unknown name or value.
+  void set_option (const std::string &name, const std::string &value);
+
+  double compute_l2_error ();
+  // L2 norm of the difference to the solution of another run on the same
+  // mesh with the same DoF numbering.
+  double compute_l2_difference (const Burger<dim> &other);
+  // L2 norm of the velocity, e.g. to make the difference relative.
+  double compute_solution_norm ();
+  types::global_dof_index n_dofs () const;
+  // Smallest and largest number of DoFs over the time steps of the last
+  // run() after the adaptive pre-refinement.
+  std::pair<types::global_dof_index, types::global_dof_index> n_dofs_range () const;
+
+  // Best-of-n wall times of the main kernels on the initial mesh, as
+  // (name, seconds) pairs.
+  std::vector<std::pair<std::string, double> >
+  run_benchmarks (const unsigned int n_repetitions);
+
+  // Heap allocations of one time step on the initial mesh with the current
+  // settings, see the definition. Only counted with the allocation_counter
+  // module preloaded.
+  std::size_t count_time_step_allocations ();
+
+private:
+  enum LinearSolverType
+  {
+    gmres,
+    fused_gmres,
+    recycling_gmres,
+    direct_umfpack
+  };
+
+  enum PreconditionerType
+  {
+    ssor_preconditioner,
+    multigrid_preconditioner
+  };
+
+  enum MGSmootherType
+  {
+    chebyshev_smoother,
+    jacobi_smoother
+  };
+
+  enum TimeIntegrationType
+  {
+    implicit_euler,
+    explicit_ssp_rk3,
+    imex_bdf2
+  };
+
+  enum InitialGuessType
+  {
+    zero_guess,
+    previous_solution_guess,
+    extrapolated_guess,
+    projected_guess
+  };
+
+  enum RefinementStrategy
+  {
+    fixed_number_strategy,
+    fixed_fraction_strategy,
+    cell_budget_strategy
+  };
+
+  /*
+   * Everything assemble_system_2() and compute_l2_error() need per cell.
+   * It is created once with the Burger object and reused, so that
+   * assembling a time step does not allocate. Field values are computed
+   * from the cell's DoF values here, since the FEValuesViews functions
+   * allocate a local vector on every call.
+   */
+  struct AssemblyScratch
+  {
+    AssemblyScratch (const FiniteElement<dim> &fe);
+
+    QGauss<dim>                           quadrature_formula;
+    FEValues<dim>                         fe_values;
+    FullMatrix<double>                    cell_matrix;
+    Vector<double>                        cell_rhs;
+    std::vector<types::global_dof_index>  local_dof_indices;
+    Vector<double>                        local_values;
+    std::vector<Tensor<1, dim> >          old_values;
+    std::vector<double>                   old_div;
+
+    Vector<double>                        local_old_old_values;
+    std::vector<Tensor<2, dim> >          old_grad;
+    std::vector<Tensor<1, dim> >          old_old_values;
+    std::vector<Tensor<1, dim> >          history;
+    std::vector<double>                   entropy_residual;
+
+    QGauss<dim>                           error_quadrature_formula;
+    FEValues<dim>                         error_fe_values;
+    Vector<double>                        exact_value;
+  };
+
+  static std::string linear_solver_name (const LinearSolverType type);
+
+  void make_grid ();
+  void setup_system();
+  void make_constraints ();
+  void resize_vectors ();
+  void assemble_system_2 ();
+  void assemble_cell_matrix (const FEValuesViews::Vector<dim>  &fe_vector_values,
+                             const FEValues<dim>               &fe_values,
+                             const std::vector<Tensor<1, dim> > &u_star,
+                             const std::vector<double>          &u_star_div,
+                             FullMatrix<double>                 &cell_matrix) const;
+  void setup_multigrid ();
+  void assemble_multigrid ();
+  void assemble_lumped_mass_matrix ();
+  void assemble_residual (const Vector<double> &u,
+                          const double          stage_time,
+                          Vector<double>       &residual) const;
+  double compute_explicit_time_step () const;
+  void explicit_step (const double max_time_step = std::numeric_limits<double>::max());
+  double compute_field_norm (const Vector<double> &field);
+  bool assemble_imex_system ();
+  double assemble_steady_system ();
+  unsigned int solve_steady_state ();
+  void compute_initial_guess ();
+  void solve ();
+  unsigned int solve_with (const LinearSolverType linear_solver_type,
+                           Vector<double>    &x,
+                           double            &wall_time);
+  template <class PreconditionerType>
+  unsigned int solve_krylov (const LinearSolverType    linear_solver_type,
+                             Vector<double>           &x,
+                             const PreconditionerType &preconditioner);
+  template <class SmootherType>
+  unsigned int solve_krylov_multigrid (const LinearSolverType                        linear_solver_type,
+                                       Vector<double>                               &x,
+                                       const MGTransferPrebuilt<Vector<double> >    &mg_transfer,
+                                       const MGCoarseGridHouseholder<>              &coarse_grid_solver,
+                                       const SmootherType                           &mg_smoother);
+  void estimate_error ();
+  bool remeshing_due ();
+  void mark_cells_for_refinement ();
+  void refine_grid (const unsigned int min_grid_level, const unsigned int max_grid_level);
+  void output_results () const;
+  std::size_t preconditioner_memory_consumption () const;
+  std::size_t krylov_workspace_memory_consumption () const;
+
+  double solution_bdf(
+    const double& sol_val,
+    const double& rhs_val,
+    const double& v_val,
+    const Tensor<1, dim>& sol_grad,
+    const Tensor<1, dim>& v_grad,
+    const Tensor<1, dim>& beta
+  ) const;
+
+  double solution_bdf1(
+    const double& sol_old,
+    const double& sol_old_old
+  ) const;
+
+  double advection_cell_operator(
+    const double& u_val,
+    const double& v_val,
+    const Tensor<1, dim>& u_grad,
+    const Tensor<1, dim>& v_grad,
+    const Tensor<1, dim>& beta
+  ) const;
+
+  double advection_face_operator(
+    const double& u_val,
+    const double& v_val,
+    const Tensor<1, dim>& beta,
+    const Tensor<1, dim>& normal
+  ) const;
+
+  double lhs_operator(
+    const double& u_val,
+    const double& v_val,
+    const Tensor<1, dim>& u_grad,
+    const Tensor<1, dim>& v_grad,
+    const double& alpha,
+    const Tensor<1, dim>& beta
+  ) const;
+
+  double streamline_diffusion(
+    const Tensor<1, dim>& u_grad,
+    const Tensor<1, dim>& v_grad,
+    const Tensor<1, dim>& beta
+  ) const;
+
+  Triangulation<dim>   triangulation;
+
+  FESystem<dim>        fe;
+
+  DoFHandler<dim>      dof_handler;
+
+  ConstraintMatrix     constraints;
+
+  SparsityPattern      sparsity_pattern;
+  SparseMatrix<double> system_matrix;
+
+  Vector<double>       old_solution;
+  Vector<double>       old_old_solution;
+  Vector<double>       solution;
+  Vector<double>       system_rhs;
+  types::global_dof_index vector_capacity;  // see ConvectionDiffusion::resize_vectors
+
+  const unsigned int   n_global_refinements;
+
+  unsigned int         timestep_number;
+  double               time_step;
+  double               time;
+
+  double               theta_imex;
+  double               theta_skew;
+
+  const double         nu = 1.0;
+
+  LinearSolverType     linear_solver;
+  bool                 compare_linear_solvers;
+  const unsigned int   krylov_basis_size = 30;
+
+  PreconditionerType   preconditioner_type;
+  MGSmootherType       mg_smoother_type;
+  unsigned int         mg_smoothing_steps;
+
+  ConstraintMatrix                     hanging_node_constraints;
+  MGConstrainedDoFs                    mg_constrained_dofs;
+  MGLevelObject<SparsityPattern>       mg_sparsity_patterns;
+  MGLevelObject<SparseMatrix<double> > mg_matrices;
+  MGLevelObject<SparseMatrix<double> > mg_interface_down;
+  MGLevelObject<SparseMatrix<double> > mg_interface_up;
+
+  TimeIntegrationType  time_integration;
+  double               cfl_number;
+  Vector<double>       inverse_lumped_mass;
+  bool                 imex_matrix_assembled;
+
+  PreconditionSSOR<>   ssor;
+  bool                 preconditioner_up_to_date;
+
+  SparseDirectUMFPACK  direct_solver;
+  bool                 factorization_up_to_date;
+
+  InitialGuessType     initial_guess;
+  const unsigned int   n_guess_history = 4;
+  std::deque<Vector<double> > guess_history;
+
+  SolverRecyclingGMRES::RecycleSpace recycle_space;
+
+  AssemblyScratch                     scratch;
+  Stabilization<dim>                  stabilization;
+  std::map<types::global_dof_index, double> boundary_values;
+  GrowingVectorMemory<Vector<double> > vector_memory;
+  SolverFusedGMRES::Workspace         fused_gmres_workspace;
+
+  std::ofstream        memory_out;
+  std::size_t          peak_rss;
+
+  DiagnosticsLog       diagnostics;
+  unsigned int         last_linear_iterations;
+  double               last_linear_residual;
+
+  RefinementStrategy   refinement_strategy;
+  double               refine_fraction;
+  double               coarsen_fraction;
+  double               target_n_dofs;
+  double               exchange_fraction;
+  double               refinement_hysteresis;
+  double               remesh_indicator_change;
+  unsigned int         min_steps_between_remeshing;
+  unsigned int         last_remesh_step;
+  std::pair<types::global_dof_index, types::global_dof_index> dofs_range;
+  Vector<float>        estimated_error_per_cell;
+  Vector<float>        reference_error_per_cell;
+
+  CellLocator<dim>     cell_locator;
+  InSituAnalysis<dim>  analysis;
+  unsigned int         snapshot_interval;
+  std::string          output_prefix;
+  ConditionalOStream   pcout;
+
+  double               steady_residual_tolerance;
+  unsigned int         max_nonlinear_iterations;
+  double               initial_pseudo_time_step;
+  double               max_pseudo_time_step;
+};
+
+
+template<int dim>
+class RightHandSide : public Function<dim>
+{
+public:
+  RightHandSide (const double& time, const double& period = 0.2)
+    :
+    Function<dim>(dim),
+    period (period),
+    time(time)
+  {}
+  virtual double value (const Point<dim> &p,
+                        const unsigned int component = 0) const;
+  virtual void vector_value (const Point<dim>  &points,
+		  Vector<double> &value) const;
+private:
+  const double period;
+  const double time ;
+};
+
+template<int dim>
+double RightHandSide<dim>::value (const Point<dim> &p,
+                                  const unsigned int component) const
+{
+
+  // The forcing acts on boxes in the x-y plane. In 3d each box is also
+  // cut off in z, alternately towards the front and the back of the
+  // cavity, and the z component is forced on boxes of its own, so that
+  // the flow has no direction of symmetry.
+//  const double time = this->get_time();
+  const double point_within_period = (time/period - std::floor(time/period));
+  const bool   front = (dim < 3) || (p[dim-1] > -0.5);
+  const bool   back  = (dim < 3) || (p[dim-1] < 0.5);
+
+
+  switch(component){
+  	  case 0:
+		  if ((point_within_period >= 0.0) && (point_within_period <= 0.2))
+			{
+			  if ((p[0] > 0.5) && (p[1] > -0.5) && front)
+				return 1;
+			  else
+				return 0;
+			}
+		  else if ((point_within_period >= 0.5) && (point_within_period <= 0.7))
+			{
+			  if ((p[0] > -0.5) && (p[1] > 0.5) && back)
+				return 1;
+			  else
+				return 0;
+			}
+		  else
+			return 0;
+
+  	  case 1:
+		  if ((point_within_period >= 0.2) && (point_within_period <= 0.4))
+			{
+			  if ((p[0] > 0.5) && (p[1] > -0.5) && back)
+				return 1;
+			  else
+				return 0;
+			}
+		  else if ((point_within_period >= 0.7) && (point_within_period <= 0.9))
+			{
+			  if ((p[0] > -0.5) && (p[1] > 0.5) && front)
+				return 1;
+			  else
+				return 0;
+			}
+		  else
+			return 0;
+
+  	  case 2:
+		  if ((point_within_period >= 0.1) && (point_within_period <= 0.3))
+			{
+			  if ((p[0] < -0.5) && (p[1] > -0.5) && front)
+				return 1;
+			  else
+				return 0;
+			}
+		  else if ((point_within_period >= 0.6) && (point_within_period <= 0.8))
+			{
+			  if ((p[0] > -0.5) && (p[1] < -0.5) && back)
+				return -1;
+			  else
+				return 0;
+			}
+		  else
+			return 0;
+
+      default: return 0;
+  }
+
+}
+
+template <int dim>
+void
+RightHandSide<dim>::vector_value (const Point<dim>  &points,
+		 	 	 	 	 	 	 Vector<double> &values) const
+{
+
+	for (unsigned int c=0; c<this->n_components; ++c)
+	  values(c) = RightHandSide<dim>::value (points, c);
+
+}
+
+template <int dim>
+void right_hand_side (const std::vector<Point<dim> > &points,
+                      std::vector<Tensor<1, dim> >   &values)
+{
+  Assert (values.size() == points.size(),
+          ExcDimensionMismatch (values.size(), points.size()));
+  Assert (dim >= 2, ExcNotImplemented());
+  Point<dim> point_1, point_2;
+  point_1(0) = 0.5;
+  point_2(0) = -0.5;
+  for (unsigned int point_n = 0; point_n < points.size(); ++point_n)
+    {
+      if (((points[point_n]-point_1).norm_square() < 0.2*0.2) ||
+          ((points[point_n]-point_2).norm_square() < 0.2*0.2))
+        values[point_n][0] = 1.0;
+      else
+        values[point_n][0] = 0.0;
+      if (points[point_n].norm_square() < 0.2*0.2)
+        values[point_n][1] = 1.0;
+      else
+        values[point_n][1] = 0.0;
+    }
+}
+
+/*
+
+template<int dim>
+class RightHandSide1 : public Function<dim>
+{
+public:
+  RightHandSide1 (const double& time) : Function<dim>(), time(time) {}
+  virtual double value (const Point<dim> &p,
+                        const unsigned int component = 0) const;
+  const double time;
+
+};
+
+template<int dim>
+double RightHandSide1<dim> ::value(const Point<dim> &p,
+		                    const unsigned int component) const{
+
+	return std::exp(-time)*(5 - 3*p[0]*p[0] -3*p[1]*p[1] + p[0]*p[0]*p[1]*p[1]);
+}
+*/
+//////////////////////////
+
+template <int dim>
+class RightHandSide1 : public Function<dim>
+{
+public:
+  RightHandSide1 () : Function<dim>(dim) {}
+  virtual double value (const Point<dim>   &p,
+						const unsigned int  component = 0) const;
+  virtual void vector_value (const Point<dim> &p,
+							 Vector<double>   &value) const;
+};
+template <int dim>
+double
+RightHandSide1<dim>::value (const Point<dim>  &p  ,
+						   const unsigned int /*component */) const
+{
+  return 0;
+}
+template <int dim>
+void
+RightHandSide1<dim>::vector_value (const Point<dim> &p,
+								  Vector<double>   &values) const
+{
+  for (unsigned int c=0; c<this->n_components; ++c)
+	values(c) = RightHandSide1<dim>::value (p, c);
+}
+
+
+template <int dim>
+class BubbleGauss : public dealii::Function<dim> {
+public:
+  BubbleGauss(const double& amplitude = 1, const double& sigma = 5, const Point<dim>& center = Point<dim>());
   double amplitude;
   double sigma;
   Point<dim> center;
@@ -318,586 +2343,4859 @@ public:
 
 };
 
-template<int dim>
-BubbleGauss<dim>::BubbleGauss(const double& amplitude, const double& sigma, const Point<dim>& center)  :  Function<dim>(dim), amplitude(amplitude), sigma(sigma), center(center) {
+template<int dim>
+BubbleGauss<dim>::BubbleGauss(const double& amplitude, const double& sigma, const Point<dim>& center)  :  Function<dim>(dim), amplitude(amplitude), sigma(sigma), center(center) {
+
+}
+
+template<int dim>
+double BubbleGauss<dim>::value(const Point<dim>& p, const unsigned component ) const {
+
+	const double& r2 = (p - center).norm_square();
+
+    // Forcing of the manufactured solution u_c = prod_d (x_d^2 - 1) for all
+    // components c: (u . grad) u_c - nu laplace u_c, with nu = 1.
+    if (component >= dim)
+      return 0;
+
+    double phi = 1;
+    for (unsigned int d=0; d<dim; ++d)
+      phi *= (p[d]*p[d] - 1);
+
+    double convection = 0;
+    double laplacian  = 0;
+    for (unsigned int d=0; d<dim; ++d)
+      {
+        double others = 1;
+        for (unsigned int e=0; e<dim; ++e)
+          if (e != d)
+            others *= (p[e]*p[e] - 1);
+
+        convection += 2*p[d]*others;
+        laplacian  += 2*others;
+      }
+
+    return phi*convection - 1.0*laplacian;
+}
+
+template <int dim>
+void
+BubbleGauss<dim>::vector_value (const Point<dim>  &points,
+		 	 	 	 	 	 	 Vector<double> &values) const
+{
+
+	for (unsigned int c=0; c<this->n_components; ++c)
+	  values(c) = BubbleGauss<dim>::value (points, c);
+
+}
+
+template <int dim>
+class ExactSolution : public dealii::Function<dim> {
+public:
+  ExactSolution(): Function<dim>(dim){} ;
+  virtual void vector_value (const Point<dim>  &points,
+		  Vector<double> &value) const;
+
+};
+
+
+template <int dim>
+void
+ExactSolution<dim>::vector_value (const Point<dim>  &p,
+		 	 	 	 	 	 	 Vector<double> &values) const
+{
+    Assert (values.size() == dim,
+            ExcDimensionMismatch (values.size(), dim));
+
+    double phi = 1;
+    for (unsigned int d=0; d<dim; ++d)
+      phi *= (p[d]*p[d] - 1);
+
+    for (unsigned int c=0; c<dim; ++c)
+      values(c) = phi;
+
+}
+/////////////////////////////////
+template <int dim>
+class BoundaryValues : public Function<dim>
+{
+public:
+  virtual double value (const Point<dim>   &p,
+                        const unsigned int  component = 0) const;
+};
+
+
+
+
+
+
+
+template<int dim>
+double BoundaryValues<dim>::value (const Point<dim> &/*p*/,
+                                   const unsigned int component) const
+{
+    Assert(component == 0, ExcInternalError());
+    return 0;
+}
+
+template<int dim>
+double Burger<dim>::solution_bdf1(
+  const double& sol_old,
+  const double& sol_old_old
+) const{
+  return(
+	+ (2.0)*sol_old - (0.5)*sol_old_old
+	);
+}
+
+template<int dim>
+double Burger<dim>::solution_bdf(
+  const double& sol_val,
+  const double& rhs_val,
+  const double& v_val,
+  const Tensor<1, dim>& sol_grad,
+  const Tensor<1, dim>& v_grad,
+  const Tensor<1, dim>& beta
+) const{
+  return(
+	+ sol_val*v_val
+	- time_step*contract(beta , sol_grad )* v_val
+//    + time_step * nu * sol_grad * v_grad
+    + time_step * rhs_val*v_val
+  );
+}
+
+template<int dim>
+double Burger<dim>::advection_cell_operator(
+  const double& u_val,
+  const double& v_val,
+  const Tensor<1, dim>& u_grad,
+  const Tensor<1, dim>& v_grad,
+  const Tensor<1, dim>& beta
+) const {
+  return (
+    + (1 - theta_skew) * contract(beta, u_grad) * v_val
+    + (0 - theta_skew) * contract(beta, v_grad) * u_val
+    );
+}
+
+
+template<int dim>
+double Burger<dim>::advection_face_operator(
+  const double& u_val,
+  const double& v_val,
+  const Tensor<1, dim>& beta,
+  const Tensor<1, dim>& normal
+) const {
+  return (
+    + theta_skew * contract(beta, normal) * v_val * u_val
+    );
+}
+
+template<int dim>
+double Burger<dim>::lhs_operator(
+  const double& u_val,
+  const double& v_val,
+  const Tensor<1, dim>& u_grad,
+  const Tensor<1, dim>& v_grad,
+  const double& alpha,
+  const Tensor<1, dim>& beta
+) const {
+  return (
+    + theta_imex * advection_cell_operator(u_val, v_val, u_grad, v_grad, beta)
+    + theta_skew * alpha * (u_grad * v_grad)
+    + alpha * (u_grad * v_grad)
+    );
+}
+
+template<int dim>
+double Burger<dim>::streamline_diffusion(
+  const Tensor<1, dim>& u_grad,
+  const Tensor<1, dim>& v_grad,
+  const Tensor<1, dim>& beta
+) const {
+  const double dt = time_step;
+  return dt*dt/6*contract(beta, u_grad) * contract(beta, v_grad);
+}
+
+template <int dim>
+Burger<dim>::Burger (const unsigned int n_global_refinements,
+                     const unsigned int fe_degree)
+  :
+  triangulation (Triangulation<dim>::limit_level_difference_at_vertices),
+  fe (FE_Q<dim>(fe_degree), dim),
+  dof_handler (triangulation),
+  vector_capacity(0),
+  n_global_refinements(n_global_refinements),
+  timestep_number(0),
+  time_step(1. / 500),
+  time(0),
+  theta_imex(0.5),
+  theta_skew(0.5),
+  linear_solver(fused_gmres),
+  compare_linear_solvers(false),
+  preconditioner_type(ssor_preconditioner),
+  mg_smoother_type(chebyshev_smoother),
+  mg_smoothing_steps(2),
+  time_integration(implicit_euler),
+  cfl_number(0.5),
+  imex_matrix_assembled(false),
+  preconditioner_up_to_date(false),
+  factorization_up_to_date(false),
+  initial_guess(zero_guess),
+  scratch(fe),
+  peak_rss(0),
+  last_linear_iterations(0),
+  last_linear_residual(0),
+  refinement_strategy(fixed_number_strategy),
+  refine_fraction(0.3),
+  coarsen_fraction(0.03),
+  target_n_dofs(20000),
+  exchange_fraction(0.05),
+  refinement_hysteresis(0.25),
+  remesh_indicator_change(0.2),
+  min_steps_between_remeshing(2),
+  last_remesh_step(0),
+  cell_locator(triangulation),
+  snapshot_interval(50),
+  pcout(std::cout),
+  steady_residual_tolerance(1e-8),
+  max_nonlinear_iterations(50),
+  initial_pseudo_time_step(0.1),
+  max_pseudo_time_step(1e10)
+{
+  // Probes at the center of the cavity and halfway to the lid, and a line
+  // sample along the vertical center line.
+  Point<dim> center, below_lid, bottom, lid;
+  below_lid[dim-1] = 0.5;
+  bottom[dim-1]    = -1;
+  lid[dim-1]       = 1;
+  analysis.add_probe (center);
+  analysis.add_probe (below_lid);
+  analysis.add_line (bottom, lid, 21);
+}
+
+template <int dim>
+Burger<dim>::AssemblyScratch::AssemblyScratch (const FiniteElement<dim> &fe)
+  :
+  quadrature_formula (fe.degree+1),
+  fe_values (fe, quadrature_formula,
+             update_values   | update_gradients |
+             update_quadrature_points | update_JxW_values),
+  cell_matrix (fe.dofs_per_cell, fe.dofs_per_cell),
+  cell_rhs (fe.dofs_per_cell),
+  local_dof_indices (fe.dofs_per_cell),
+  local_values (fe.dofs_per_cell),
+  old_values (quadrature_formula.size()),
+  old_div (quadrature_formula.size()),
+  local_old_old_values (fe.dofs_per_cell),
+  old_grad (quadrature_formula.size()),
+  old_old_values (quadrature_formula.size()),
+  history (quadrature_formula.size()),
+  entropy_residual (quadrature_formula.size()),
+  error_quadrature_formula (fe.degree+2),
+  error_fe_values (fe, error_quadrature_formula,
+                   update_values | update_quadrature_points | update_JxW_values),
+  exact_value (dim)
+{}
+
+template <int dim>
+Burger<dim>::~Burger (){
+  dof_handler.clear ();
+}
+
+template <int dim>
+void Burger<dim>::set_time_step (const double time_step)
+{
+  this->time_step = time_step;
+}
+
+template <int dim>
+void Burger<dim>::set_output_prefix (const std::string &prefix)
+{
+  output_prefix = prefix;
+}
+
+template <int dim>
+void Burger<dim>::set_verbose (const bool verbose)
+{
+  pcout.set_condition (verbose);
+}
+
+template <int dim>
+void Burger<dim>::set_compare_linear_solvers (const bool compare)
+{
+  compare_linear_solvers = compare;
+}
+
+template <int dim>
+void Burger<dim>::set_stabilization (const unsigned int terms)
+{
+  stabilization.terms = terms;
+}
+
+template <int dim>
+void Burger<dim>::set_option (const std::string &name, const std::string &value)
+{
+  if (name == "linear_solver")
+    {
+      // gmres | fused_gmres | recycling_gmres | direct_umfpack
+      const char *names[] = { "gmres", "fused_gmres", "recycling_gmres", "direct_umfpack" };
+      const LinearSolverType types[] = { gmres, fused_gmres, recycling_gmres, direct_umfpack };
+      for (unsigned int i=0; i<sizeof(types)/sizeof(types[0]); ++i)
+        if (value == names[i])
+          {
+            linear_solver = types[i];
+            return;
+          }
+    }
+
+  if (name == "initial_guess")
+    {
+      // zero | previous | extrapolated | projected
+      const char *names[] = { "zero", "previous", "extrapolated", "projected" };
+      const InitialGuessType types[] = { zero_guess, previous_solution_guess,
+                                         extrapolated_guess, projected_guess
+                                       };
+      for (unsigned int i=0; i<sizeof(types)/sizeof(types[0]); ++i)
+        if (value == names[i])
+          {
+            initial_guess = types[i];
+            return;
+          }
+    }
+
+  if (name == "time_integration")
+    {
+      // implicit_euler | ssp_rk3 | imex_bdf2
+      const char *names[] = { "implicit_euler", "ssp_rk3", "imex_bdf2" };
+      const TimeIntegrationType types[] = { implicit_euler, explicit_ssp_rk3, imex_bdf2 };
+      for (unsigned int i=0; i<sizeof(types)/sizeof(types[0]); ++i)
+        if (value == names[i])
+          {
+            time_integration = types[i];
+            return;
+          }
+    }
+
+  if (name == "cfl_number")
+    {
+      cfl_number = Utilities::string_to_double (value);
+      return;
+    }
+
+  if (name == "snapshot_interval")
+    {
+      // Time steps between full-field VTK snapshots, 0 for none.
+      snapshot_interval = Utilities::string_to_int (value);
+      return;
+    }
+
+  if (name == "refinement_strategy")
+    {
+      // fixed_number | fixed_fraction | cell_budget
+      const char *names[] = { "fixed_number", "fixed_fraction", "cell_budget" };
+      const RefinementStrategy types[] = { fixed_number_strategy, fixed_fraction_strategy,
+                                           cell_budget_strategy
+                                         };
+      for (unsigned int i=0; i<sizeof(types)/sizeof(types[0]); ++i)
+        if (value == names[i])
+          {
+            refinement_strategy = types[i];
+            return;
+          }
+    }
+
+  // Parameters of the fixed_fraction and cell_budget strategies.
+  if (name == "refine_fraction")
+    {
+      refine_fraction = Utilities::string_to_double (value);
+      return;
+    }
+  if (name == "coarsen_fraction")
+    {
+      coarsen_fraction = Utilities::string_to_double (value);
+      return;
+    }
+  if (name == "target_n_dofs")
+    {
+      target_n_dofs = Utilities::string_to_double (value);
+      return;
+    }
+  if (name == "exchange_fraction")
+    {
+      exchange_fraction = Utilities::string_to_double (value);
+      return;
+    }
+  if (name == "refinement_hysteresis")
+    {
+      refinement_hysteresis = Utilities::string_to_double (value);
+      return;
+    }
+  if (name == "remesh_indicator_change")
+    {
+      remesh_indicator_change = Utilities::string_to_double (value);
+      return;
+    }
+  if (name == "min_steps_between_remeshing")
+    {
+      min_steps_between_remeshing = Utilities::string_to_int (value);
+      return;
+    }
+
+  if (name == "preconditioner")
+    {
+      // ssor | multigrid
+      if ((value == "ssor") || (value == "multigrid"))
+        {
+          preconditioner_type = (value == "ssor" ? ssor_preconditioner
+                                 : multigrid_preconditioner);
+          return;
+        }
+    }
+
+  if (name == "mg_smoother")
+    {
+      // chebyshev | jacobi
+      if ((value == "chebyshev") || (value == "jacobi"))
+        {
+          mg_smoother_type = (value == "chebyshev" ? chebyshev_smoother
+                              : jacobi_smoother);
+          return;
+        }
+    }
+
+  if (name == "mg_smoothing_steps")
+    {
+      mg_smoothing_steps = Utilities::string_to_int (value);
+      return;
+    }
+
+  AssertThrow (false, ExcMessage ("Unknown option " + name + "=" + value));
+}
+
+template <int dim>
+types::global_dof_index Burger<dim>::n_dofs () const
+{
+  return dof_handler.n_dofs ();
+}
+
+template <int dim>
+std::pair<types::global_dof_index, types::global_dof_index> Burger<dim>::n_dofs_range () const
+{
+  return dofs_range;
+}
+
+template <int dim>
+void Burger<dim>::make_grid ()
+{
+//  GridGenerator::hyper_L(triangulation);
+  GridGenerator::hyper_cube (triangulation, -1, 1);
+  triangulation.refine_global (n_global_refinements);
+
+  pcout << "   Number of active cells: "
+        << triangulation.n_active_cells()
+        << std::endl
+        << "   Total number of cells: "
+        << triangulation.n_cells()
+        << std::endl;
+}
+
+
+template <int dim>
+void Burger<dim>::setup_system ()
+{
+  dof_handler.distribute_dofs (fe);
+
+  // A bandwidth reducing numbering keeps the fill of the direct solver's
+  // factors local; UMFPACK's own ordering then works on a banded matrix.
+  if (linear_solver == direct_umfpack)
+    DoFRenumbering::Cuthill_McKee (dof_handler);
+
+  pcout << "   Number of degrees of freedom: "
+        << dof_handler.n_dofs()
+        << std::endl;
+
+  // The constraints and the vectors do not depend on each other; the
+  // sparsity pattern needs the constraints.
+  Threads::TaskGroup<> tasks;
+  tasks += Threads::new_task (&Burger<dim>::make_constraints, *this);
+  tasks += Threads::new_task (&Burger<dim>::resize_vectors, *this);
+  tasks.join_all ();
+
+  ConvectionDiffusion::make_sparsity_pattern (dof_handler, constraints, sparsity_pattern);
+
+  // Kept for all time steps on this mesh.
+  boundary_values.clear ();
+  VectorTools::interpolate_boundary_values (dof_handler,
+                                            0,
+                                            ZeroFunction<dim>(dim),
+                                            boundary_values);
+
+  system_matrix.reinit (sparsity_pattern);
+  imex_matrix_assembled     = false;
+  preconditioner_up_to_date = false;
+  factorization_up_to_date  = false;
+
+  if (preconditioner_type == multigrid_preconditioner)
+    setup_multigrid ();
+
+  if (time_integration == explicit_ssp_rk3)
+    assemble_lumped_mass_matrix ();
+}
+
+
+
+template <int dim>
+void Burger<dim>::make_constraints ()
+{
+  constraints.clear ();
+  DoFTools::make_hanging_node_constraints (dof_handler,
+                                           constraints);
+
+  VectorTools::interpolate_boundary_values (dof_handler,
+                                            0,
+                                            ZeroFunction<dim>(dim),
+                                            constraints);
+
+
+  constraints.close();
+}
+
+
+
+template <int dim>
+void Burger<dim>::resize_vectors ()
+{
+  Vector<double> *const vectors[] = { &solution, &old_solution, &old_old_solution, &system_rhs };
+  ConvectionDiffusion::resize_vectors (vectors, sizeof(vectors)/sizeof(vectors[0]),
+                                       dof_handler.n_dofs(), vector_capacity);
+}
+
+
+
+template <int dim>
+void Burger<dim>::setup_multigrid ()
+{
+  dof_handler.distribute_mg_dofs (fe);
+
+  hanging_node_constraints.clear ();
+  DoFTools::make_hanging_node_constraints (dof_handler,
+                                           hanging_node_constraints);
+  hanging_node_constraints.close ();
+
+  typename FunctionMap<dim>::type      dirichlet_boundary;
+  const ZeroFunction<dim>              homogeneous_dirichlet_bc (dim);
+  dirichlet_boundary[0] = &homogeneous_dirichlet_bc;
+
+  mg_constrained_dofs.clear ();
+  mg_constrained_dofs.initialize (dof_handler, dirichlet_boundary);
+
+  const unsigned int n_levels = triangulation.n_levels();
+
+  mg_interface_down.resize (0, n_levels-1);
+  mg_interface_down.clear ();
+  mg_interface_up.resize (0, n_levels-1);
+  mg_interface_up.clear ();
+  mg_matrices.resize (0, n_levels-1);
+  mg_matrices.clear ();
+  mg_sparsity_patterns.resize (0, n_levels-1);
+
+  for (unsigned int level=0; level<n_levels; ++level)
+    {
+      DynamicSparsityPattern c_sparsity (dof_handler.n_dofs(level),
+                                         dof_handler.n_dofs(level));
+      MGTools::make_sparsity_pattern (dof_handler, c_sparsity, level);
+
+      mg_sparsity_patterns[level].copy_from (c_sparsity);
+
+      mg_matrices[level].reinit (mg_sparsity_patterns[level]);
+      mg_interface_down[level].reinit (mg_sparsity_patterns[level]);
+      mg_interface_up[level].reinit (mg_sparsity_patterns[level]);
+    }
+}
+
+
+template <int dim>
+void Burger<dim>::assemble_cell_matrix (const FEValuesViews::Vector<dim>   &fe_vector_values,
+                                        const FEValues<dim>                &fe_values,
+                                        const std::vector<Tensor<1, dim> > &u_star_values,
+                                        const std::vector<double>          &u_star_div_values,
+                                        FullMatrix<double>                 &cell_matrix) const
+{
+  const unsigned int   dofs_per_cell = cell_matrix.m();
+  const unsigned int   n_q_points    = u_star_values.size();
+
+  cell_matrix = 0;
+
+  if (time_integration == imex_bdf2)
+    {
+      // BDF2 mass term and implicit viscosity; convection is on the right
+      // hand side, so the operator does not depend on u_star.
+      for (unsigned int q_index=0; q_index<n_q_points; ++q_index)
+        for (unsigned int i=0; i<dofs_per_cell; ++i)
+          {
+            const Tensor<1, dim>& u_val   = fe_vector_values.value(i, q_index);
+            const Tensor<2, dim>& u_grad  = fe_vector_values.gradient(i, q_index);
+
+            for (unsigned int j=0; j<dofs_per_cell; ++j)
+              cell_matrix(i,j) += ( 1.5 * u_val * fe_vector_values.value(j, q_index)
+                                    +
+                                    nu*time_step*double_contract(u_grad, fe_vector_values.gradient(j, q_index))
+                                  )*fe_values.JxW (q_index);
+          }
+      return;
+    }
+
+  // The implicit Euler operator is the one of the shared convection-
+  // diffusion core, with compile-time loop bounds for Q1 and Q2.
+  if (ConvectionDiffusion::vector_burgers_cell_matrix (fe_values, u_star_values, u_star_div_values,
+                                                       nu, time_step, cell_matrix))
+    return;
+
+  for (unsigned int q_index=0; q_index<n_q_points; ++q_index)
+    for (unsigned int i=0; i<dofs_per_cell; ++i)
+      {
+        const Tensor<1, dim>& u_val   = fe_vector_values.value(i, q_index);
+        const Tensor<2, dim>& u_grad  = fe_vector_values.gradient(i, q_index);
+
+        for (unsigned int j=0; j<dofs_per_cell; ++j)
+          cell_matrix(i,j) += ConvectionDiffusion::VectorBurgers<dim>::operator_entry
+                              (nu, time_step,
+                               u_star_values[q_index], u_star_div_values[q_index],
+                               u_val, u_grad,
+                               fe_vector_values.value(j, q_index),
+                               fe_vector_values.gradient(j, q_index))
+                              * fe_values.JxW (q_index);
+      }
+}
+
+
+
+template <int dim>
+void Burger<dim>::assemble_system_2 ()
+{
+  BURGER_PERF_REGION ("assembly");
+//  const BubbleGauss<dim>  right_hand_side;
+  const RightHandSide<dim> right_hand_side(time);
+//    const ZeroFunction<dim>   right_hand_side(dim);
+
+  system_matrix = 0;
+  system_rhs    = 0;
+  preconditioner_up_to_date = false;
+  factorization_up_to_date  = false;
+
+  FEValues<dim> &fe_values = scratch.fe_values;
+
+  const unsigned int   dofs_per_cell = fe.dofs_per_cell;
+  const unsigned int   n_q_points    = scratch.quadrature_formula.size();
+
+  FullMatrix<double>   &cell_matrix = scratch.cell_matrix;
+  Vector<double>       &cell_rhs    = scratch.cell_rhs;
+
+  std::vector<types::global_dof_index> &local_dof_indices = scratch.local_dof_indices;
+  std::vector<Tensor<1, dim> >         &old_values        = scratch.old_values;
+  std::vector<double>                  &old_div           = scratch.old_div;
+
+  // Scale of the entropy E = |u|^2/2 for the entropy viscosity.
+  const double entropy_normalization
+    = std::max (0.5 * dim * std::pow (old_solution.linfty_norm (), 2), 1e-12);
+
+  typename DoFHandler<dim>::active_cell_iterator
+  cell = dof_handler.begin_active(),
+  endc = dof_handler.end();
+
+  for (; cell!=endc; ++cell)
+    {
+      fe_values.reinit (cell);
+
+      const FEValuesViews::Vector<dim>& fe_vector_values = fe_values[FEValuesExtractors::Vector(0)];
+
+      cell_matrix = 0;
+      cell_rhs = 0;
+
+      cell->get_dof_values (old_solution, scratch.local_values);
+      for (unsigned int q_index=0; q_index<n_q_points; ++q_index)
+        {
+          old_values[q_index] = 0;
+          old_div[q_index]    = 0;
+          for (unsigned int i=0; i<dofs_per_cell; ++i)
+            {
+              old_values[q_index] += scratch.local_values(i) * fe_vector_values.value (i, q_index);
+              old_div[q_index]    += scratch.local_values(i) * fe_vector_values.divergence (i, q_index);
+            }
+        }
+
+      if (stabilization.needs_entropy_residual ())
+        {
+          // R_E = (E(u^n) - E(u^{n-1}))/dt + u^n . grad E(u^n).
+          cell->get_dof_values (old_old_solution, scratch.local_old_old_values);
+          for (unsigned int q_index=0; q_index<n_q_points; ++q_index)
+            {
+              scratch.old_grad[q_index]       = 0;
+              scratch.old_old_values[q_index] = 0;
+              for (unsigned int i=0; i<dofs_per_cell; ++i)
+                {
+                  scratch.old_grad[q_index]       += scratch.local_values(i) * fe_vector_values.gradient (i, q_index);
+                  scratch.old_old_values[q_index] += scratch.local_old_old_values(i) * fe_vector_values.value (i, q_index);
+                }
+
+              const Tensor<1, dim> &u = old_values[q_index];
+              double transport = 0;
+              for (unsigned int c=0; c<dim; ++c)
+                for (unsigned int d=0; d<dim; ++d)
+                  transport += u[d] * scratch.old_grad[q_index][c][d] * u[c];
+              scratch.entropy_residual[q_index]
+                = 0.5 * (u * u - scratch.old_old_values[q_index] * scratch.old_old_values[q_index]) / time_step
+                  + transport;
+            }
+        }
+      if (stabilization.active ())
+        stabilization.reinit (cell->diameter (), nu, time_step, old_values,
+                              scratch.entropy_residual, entropy_normalization);
+
+
+      for (unsigned int q_index=0; q_index<n_q_points; ++q_index){
+
+
+          Tensor<1, dim> rhs_val;
+
+          for (int d = 0; d < dim; ++d) {
+            rhs_val[d] += right_hand_side.value(fe_values.quadrature_point(q_index), d);
+          }
+
+        for (unsigned int i=0; i<dofs_per_cell; ++i)
+          {
+            const Tensor<1, dim>& u_val   = fe_vector_values.value(i, q_index);
+            				//2.0*old_values[q_index]* u_val - 0.5*old_old_values[q_index]* u_val
+            cell_rhs(i) += (old_values[q_index]* u_val  + time_step * (rhs_val * u_val)
+                               )* fe_values.JxW (q_index);
+          }
+
+        scratch.history[q_index] = old_values[q_index] + time_step * rhs_val;
+      }
+
+      assemble_cell_matrix (fe_vector_values, fe_values,
+                            old_values, old_div,
+                            cell_matrix);
+
+      if (stabilization.active ())
+        {
+          stabilization.add_cell_matrix (fe_vector_values, fe_values,
+                                         old_values, time_step, cell_matrix);
+          stabilization.add_cell_rhs (fe_vector_values, fe_values,
+                                      old_values, scratch.history, cell_rhs);
+        }
+
+      cell->get_dof_indices (local_dof_indices);
+     constraints.distribute_local_to_global(cell_matrix,
+                                          cell_rhs,
+                                          local_dof_indices,
+                                          system_matrix,
+                                          system_rhs);
+
+    }
+
+
+//  BoundaryValues<dim> boundary_values_function;
+//  boundary_values_function.set_time(time);
+
+  MatrixTools::apply_boundary_values (boundary_values,
+                                      system_matrix,
+                                      solution,
+                                      system_rhs);
+
+}
+
+
+template <int dim>
+double Burger<dim>::compute_l2_error ()
+{
+  // Same as VectorTools::integrate_difference() with the L2 norm on the
+  // velocity, but with the FEValues object and buffers of scratch.
+  const ExactSolution<dim> exact_solution;
+  FEValues<dim>           &fe_values  = scratch.error_fe_values;
+  const unsigned int       n_q_points = scratch.error_quadrature_formula.size();
+
+  double error_square = 0;
+
+  typename DoFHandler<dim>::active_cell_iterator
+  cell = dof_handler.begin_active(),
+  endc = dof_handler.end();
+  for (; cell!=endc; ++cell)
+    {
+      fe_values.reinit (cell);
+      cell->get_dof_values (solution, scratch.local_values);
+
+      for (unsigned int q_index=0; q_index<n_q_points; ++q_index)
+        {
+          exact_solution.vector_value (fe_values.quadrature_point (q_index), scratch.exact_value);
+          for (unsigned int i=0; i<fe.dofs_per_cell; ++i)
+            scratch.exact_value(fe.system_to_component_index (i).first)
+            -= scratch.local_values(i) * fe_values.shape_value (i, q_index);
+          error_square += (scratch.exact_value * scratch.exact_value) * fe_values.JxW (q_index);
+        }
+    }
+
+  return std::sqrt (error_square);
+}
+
+
+template <int dim>
+double Burger<dim>::compute_l2_difference (const Burger<dim> &other)
+{
+  AssertThrow (other.solution.size() == solution.size(),
+               ExcDimensionMismatch (other.solution.size(), solution.size()));
+
+  Vector<double> difference (solution);
+  difference -= other.solution;
+  return compute_field_norm (difference);
+}
+
+
+template <int dim>
+double Burger<dim>::compute_solution_norm ()
+{
+  return compute_field_norm (solution);
+}
+
+
+template <int dim>
+double Burger<dim>::compute_field_norm (const Vector<double> &field)
+{
+  FEValues<dim>     &fe_values  = scratch.error_fe_values;
+  const unsigned int n_q_points = scratch.error_quadrature_formula.size();
+
+  double norm_square = 0;
+
+  typename DoFHandler<dim>::active_cell_iterator
+  cell = dof_handler.begin_active(),
+  endc = dof_handler.end();
+  for (; cell!=endc; ++cell)
+    {
+      fe_values.reinit (cell);
+      cell->get_dof_values (field, scratch.local_values);
+
+      for (unsigned int q_index=0; q_index<n_q_points; ++q_index)
+        {
+          scratch.exact_value = 0;
+          for (unsigned int i=0; i<fe.dofs_per_cell; ++i)
+            scratch.exact_value(fe.system_to_component_index (i).first)
+            += scratch.local_values(i) * fe_values.shape_value (i, q_index);
+          norm_square += (scratch.exact_value * scratch.exact_value) * fe_values.JxW (q_index);
+        }
+    }
+
+  return std::sqrt (norm_square);
+}
+
+
+template <int dim>
+bool Burger<dim>::assemble_imex_system ()
+{
+  BURGER_PERF_REGION ("assembly");
+
+  // IMEX BDF2: 3/2 u^{n+1} - dt nu laplace u^{n+1}
+  //            = 2 u^n - 1/2 u^{n-1} - dt (u* . grad) u* + dt f,
+  // with u* = 2 u^n - u^{n-1} and the convection in the skew-symmetric form
+  // of advection_cell_operator(). The matrix only changes with the mesh, so
+  // it is assembled once after each setup_system(), and the preconditioner
+  // built for it is reused until then. At the first step of a run
+  // u^{n-1} = u^n is used, i.e. an implicit Euler step of length 2/3 dt.
+  QGauss<dim>  quadrature_formula(fe.degree+1);
+
+  const RightHandSide<dim> right_hand_side(time + time_step);
+
+  const bool assemble_matrix = !imex_matrix_assembled;
+  if (assemble_matrix)
+    {
+      system_matrix = 0;
+      preconditioner_up_to_date = false;
+      factorization_up_to_date  = false;
+    }
+  system_rhs = 0;
+
+  FEValues<dim> fe_values (fe, quadrature_formula,
+                           update_values   | update_gradients |
+                           update_quadrature_points | update_JxW_values);
+
+  const unsigned int   dofs_per_cell = fe.dofs_per_cell;
+  const unsigned int   n_q_points    = quadrature_formula.size();
+
+  FullMatrix<double>   cell_matrix (dofs_per_cell, dofs_per_cell);
+  Vector<double>       cell_rhs (dofs_per_cell);
+
+  std::vector<types::global_dof_index> local_dof_indices (dofs_per_cell);
+  std::vector<Tensor<1, dim> >         old_values (n_q_points);
+  std::vector<Tensor<1, dim> >         old_old_values (n_q_points);
+  std::vector<Tensor<2, dim> >         old_grad (n_q_points);
+  std::vector<Tensor<2, dim> >         old_old_grad (n_q_points);
+  std::vector<Vector<double> >         rhs_values (n_q_points, Vector<double>(dim));
+
+  const Vector<double> &previous_solution = (timestep_number == 0 ? old_solution : old_old_solution);
+
+  typename DoFHandler<dim>::active_cell_iterator
+  cell = dof_handler.begin_active(),
+  endc = dof_handler.end();
+  for (; cell!=endc; ++cell)
+    {
+      fe_values.reinit (cell);
+      const FEValuesViews::Vector<dim>& fe_vector_values = fe_values[FEValuesExtractors::Vector(0)];
+
+      fe_vector_values.get_function_values (old_solution, old_values);
+      fe_vector_values.get_function_gradients (old_solution, old_grad);
+      fe_vector_values.get_function_values (previous_solution, old_old_values);
+      fe_vector_values.get_function_gradients (previous_solution, old_old_grad);
+      right_hand_side.vector_value_list (fe_values.get_quadrature_points(),
+                                         rhs_values);
+
+      cell_rhs = 0;
+      for (unsigned int q_index=0; q_index<n_q_points; ++q_index)
+        {
+          Tensor<1, dim> rhs_val, history, u_star;
+          Tensor<2, dim> u_star_grad;
+          for (unsigned int c=0; c<dim; ++c)
+            {
+              rhs_val[c] = rhs_values[q_index](c);
+              history[c] = solution_bdf1 (old_values[q_index][c], old_old_values[q_index][c]);
+              u_star[c]  = 2*old_values[q_index][c] - old_old_values[q_index][c];
+              for (unsigned int d=0; d<dim; ++d)
+                u_star_grad[c][d] = 2*old_grad[q_index][c][d] - old_old_grad[q_index][c][d];
+            }
+
+          for (unsigned int i=0; i<dofs_per_cell; ++i)
+            {
+              const Tensor<1, dim>& v_val  = fe_vector_values.value(i, q_index);
+              const Tensor<2, dim>& v_grad = fe_vector_values.gradient(i, q_index);
+
+              double convection = 0;
+              for (unsigned int c=0; c<dim; ++c)
+                convection += advection_cell_operator (u_star[c], v_val[c],
+                                                       u_star_grad[c], v_grad[c],
+                                                       u_star);
+
+              cell_rhs(i) += ( history * v_val
+                               + time_step * (rhs_val * v_val - convection)
+                             )*fe_values.JxW (q_index);
+            }
+        }
+
+      cell->get_dof_indices (local_dof_indices);
+      if (assemble_matrix)
+        {
+          assemble_cell_matrix (fe_vector_values, fe_values,
+                                old_values, std::vector<double>(n_q_points),
+                                cell_matrix);
+          constraints.distribute_local_to_global (cell_matrix, cell_rhs,
+                                                  local_dof_indices,
+                                                  system_matrix, system_rhs);
+        }
+      else
+        constraints.distribute_local_to_global (cell_rhs, local_dof_indices,
+                                                system_rhs);
+    }
+
+  // The Dirichlet values are homogeneous and part of the constraints, so
+  // distribute_local_to_global() has already set up the boundary rows.
+  imex_matrix_assembled = true;
+  return assemble_matrix;
+}
+
+
+
+template <int dim>
+void Burger<dim>::assemble_multigrid ()
+{
+  BURGER_PERF_REGION ("assembly");
+
+  // The level matrices discretize the same linearized operator as
+  // assemble_system_2(). On cells that are not active, the convection
+  // velocity u_star is interpolated from the active descendants of the
+  // cell, which gives a consistent coarse representation of old_solution
+  // on every level, also where the mesh is locally refined.
+  QGauss<dim>  quadrature_formula(fe.degree+1);
+
+  FEValues<dim> fe_values (fe, quadrature_formula,
+                           update_values   | update_gradients |
+                           update_JxW_values);
+
+  const unsigned int   dofs_per_cell = fe.dofs_per_cell;
+  const unsigned int   n_q_points    = quadrature_formula.size();
+
+  FullMatrix<double>   cell_matrix (dofs_per_cell, dofs_per_cell);
+  FullMatrix<double>   interface_matrix (dofs_per_cell, dofs_per_cell);
+
+  std::vector<types::global_dof_index> local_dof_indices (dofs_per_cell);
+  Vector<double>                       local_u_star (dofs_per_cell);
+  std::vector<Tensor<1, dim> >         u_star_values (n_q_points);
+  std::vector<double>                  u_star_div (n_q_points);
+
+  const FEValuesExtractors::Vector     velocities (0);
+
+  Stabilization<dim> level_stabilization = stabilization;
+  level_stabilization.terms &= ~Stabilization<dim>::entropy_viscosity;
+
+  const std::vector<std::vector<bool> > interface_dofs
+    = mg_constrained_dofs.get_refinement_edge_indices ();
+  const std::vector<std::vector<bool> > boundary_interface_dofs
+    = mg_constrained_dofs.get_refinement_edge_boundary_indices ();
+
+  std::vector<ConstraintMatrix> boundary_constraints (triangulation.n_levels());
+  std::vector<ConstraintMatrix> boundary_interface_constraints (triangulation.n_levels());
+  for (unsigned int level=0; level<triangulation.n_levels(); ++level)
+    {
+      boundary_constraints[level].add_lines (interface_dofs[level]);
+      boundary_constraints[level].add_lines (mg_constrained_dofs.get_boundary_indices()[level]);
+      boundary_constraints[level].close ();
+
+      boundary_interface_constraints[level]
+      .add_lines (boundary_interface_dofs[level]);
+      boundary_interface_constraints[level].close ();
+
+      mg_matrices[level]       = 0;
+      mg_interface_down[level] = 0;
+      mg_interface_up[level]   = 0;
+    }
+
+  typename DoFHandler<dim>::cell_iterator cell = dof_handler.begin(),
+                                          endc = dof_handler.end();
+  for (; cell!=endc; ++cell)
+    {
+      fe_values.reinit (cell);
+      const FEValuesViews::Vector<dim>& fe_vector_values = fe_values[velocities];
+
+      cell->get_interpolated_dof_values (old_solution, local_u_star);
+      for (unsigned int q_index=0; q_index<n_q_points; ++q_index)
+        {
+          u_star_values[q_index] = Tensor<1, dim>();
+          u_star_div[q_index]    = 0;
+          for (unsigned int j=0; j<dofs_per_cell; ++j)
+            {
+              u_star_values[q_index] += local_u_star(j) * fe_vector_values.value(j, q_index);
+              u_star_div[q_index]    += local_u_star(j) * fe_vector_values.divergence(j, q_index);
+            }
+        }
+
+      assemble_cell_matrix (fe_vector_values, fe_values,
+                            u_star_values, u_star_div,
+                            cell_matrix);
+
+      // The level operators get SUPG and grad-div; the entropy viscosity
+      // needs u^{n-1} and is left to the fine level system.
+      if (level_stabilization.active () && (time_integration == implicit_euler))
+        {
+          level_stabilization.reinit (cell->diameter (), nu, time_step, u_star_values,
+                                      std::vector<double>(), 1.);
+          level_stabilization.add_cell_matrix (fe_vector_values, fe_values,
+                                               u_star_values, time_step, cell_matrix);
+        }
+
+      const unsigned int level = cell->level();
+      cell->get_mg_dof_indices (local_dof_indices);
+      boundary_constraints[level]
+      .distribute_local_to_global (cell_matrix,
+                                   local_dof_indices,
+                                   mg_matrices[level]);
+
+      // The operator is not symmetric, so the two edge matrices differ.
+      // Multigrid applies the first one with vmult(), which needs the
+      // coupling A(edge,interior) at (edge row, interior column), and the
+      // second one with Tvmult(), which needs the transpose of the coupling
+      // A(interior,edge), i.e. A(interior,edge) stored at (edge row,
+      // interior column) as well.
+      for (unsigned int i=0; i<dofs_per_cell; ++i)
+        for (unsigned int j=0; j<dofs_per_cell; ++j)
+          interface_matrix(i,j)
+            = ((interface_dofs[level][local_dof_indices[i]] == true) &&
+               (interface_dofs[level][local_dof_indices[j]] == false))
+              ? cell_matrix(i,j) : 0;
+      boundary_interface_constraints[level]
+      .distribute_local_to_global (interface_matrix,
+                                   local_dof_indices,
+                                   mg_interface_down[level]);
+
+      for (unsigned int i=0; i<dofs_per_cell; ++i)
+        for (unsigned int j=0; j<dofs_per_cell; ++j)
+          interface_matrix(i,j)
+            = ((interface_dofs[level][local_dof_indices[i]] == true) &&
+               (interface_dofs[level][local_dof_indices[j]] == false))
+              ? cell_matrix(j,i) : 0;
+      boundary_interface_constraints[level]
+      .distribute_local_to_global (interface_matrix,
+                                   local_dof_indices,
+                                   mg_interface_up[level]);
+    }
+}
+
+
+
+template <int dim>
+void Burger<dim>::assemble_lumped_mass_matrix ()
+{
+  // Row sums of the mass matrix. For the primitive vector element only the
+  // shape functions of the same component contribute to a row, and those
+  // sum to one, so the row sum is the integral of the shape function.
+  QGauss<dim>  quadrature_formula(fe.degree+1);
+
+  FEValues<dim> fe_values (fe, quadrature_formula,
+                           update_values | update_JxW_values);
+
+  const unsigned int   dofs_per_cell = fe.dofs_per_cell;
+  const unsigned int   n_q_points    = quadrature_formula.size();
+
+  Vector<double>       cell_mass (dofs_per_cell);
+  std::vector<types::global_dof_index> local_dof_indices (dofs_per_cell);
+
+  Vector<double>       lumped_mass (dof_handler.n_dofs());
+
+  typename DoFHandler<dim>::active_cell_iterator
+  cell = dof_handler.begin_active(),
+  endc = dof_handler.end();
+  for (; cell!=endc; ++cell)
+    {
+      fe_values.reinit (cell);
+      cell_mass = 0;
+      for (unsigned int q_index=0; q_index<n_q_points; ++q_index)
+        for (unsigned int i=0; i<dofs_per_cell; ++i)
+          cell_mass(i) += fe_values.shape_value (i, q_index) * fe_values.JxW (q_index);
+
+      cell->get_dof_indices (local_dof_indices);
+      constraints.distribute_local_to_global (cell_mass, local_dof_indices, lumped_mass);
+    }
+
+  // Constrained rows stay zero, so the update never touches them;
+  // constraints.distribute() fills them in after each stage.
+  inverse_lumped_mass.reinit (dof_handler.n_dofs());
+  for (unsigned int i=0; i<dof_handler.n_dofs(); ++i)
+    if (!constraints.is_constrained (i) && (lumped_mass(i) > 0))
+      inverse_lumped_mass(i) = 1. / lumped_mass(i);
+}
+
+
+
+template <int dim>
+void Burger<dim>::assemble_residual (const Vector<double> &u,
+                                     const double          stage_time,
+                                     Vector<double>       &residual) const
+{
+  // Weak form of f - (u . grad) u - 1/2 (div u) u + nu laplace u, i.e. the
+  // convection and viscous terms of assemble_system_2() evaluated with the
+  // current state instead of linearized around old_solution.
+  QGauss<dim>  quadrature_formula(fe.degree+1);
+
+  const RightHandSide<dim> right_hand_side(stage_time);
+
+  FEValues<dim> fe_values (fe, quadrature_formula,
+                           update_values   | update_gradients |
+                           update_quadrature_points | update_JxW_values);
+
+  const unsigned int   dofs_per_cell = fe.dofs_per_cell;
+  const unsigned int   n_q_points    = quadrature_formula.size();
+
+  Vector<double>       cell_residual (dofs_per_cell);
+  std::vector<types::global_dof_index> local_dof_indices (dofs_per_cell);
+
+  std::vector<Tensor<1, dim> >         u_values (n_q_points);
+  std::vector<Tensor<2, dim> >         u_grad (n_q_points);
+  std::vector<double>                  u_div (n_q_points);
+  std::vector<Vector<double> >         rhs_values (n_q_points, Vector<double>(dim));
+
+  residual = 0;
+
+  typename DoFHandler<dim>::active_cell_iterator
+  cell = dof_handler.begin_active(),
+  endc = dof_handler.end();
+  for (; cell!=endc; ++cell)
+    {
+      fe_values.reinit (cell);
+      const FEValuesViews::Vector<dim>& fe_vector_values = fe_values[FEValuesExtractors::Vector(0)];
+
+      fe_vector_values.get_function_values (u, u_values);
+      fe_vector_values.get_function_gradients (u, u_grad);
+      fe_vector_values.get_function_divergences (u, u_div);
+      right_hand_side.vector_value_list (fe_values.get_quadrature_points(),
+                                         rhs_values);
+
+      cell_residual = 0;
+      for (unsigned int q_index=0; q_index<n_q_points; ++q_index)
+        {
+          Tensor<1, dim> rhs_val;
+          for (int d = 0; d < dim; ++d)
+            rhs_val[d] = rhs_values[q_index](d);
+
+          const Tensor<1, dim> convection = u_grad[q_index] * u_values[q_index];
+
+          for (unsigned int i=0; i<dofs_per_cell; ++i)
+            {
+              const Tensor<1, dim>& v_val  = fe_vector_values.value(i, q_index);
+              const Tensor<2, dim>& v_grad = fe_vector_values.gradient(i, q_index);
+
+              cell_residual(i) += ( rhs_val * v_val
+                                    - convection * v_val
+                                    - 0.5*u_div[q_index]*(u_values[q_index] * v_val)
+                                    - nu*double_contract(u_grad[q_index], v_grad)
+                                  )*fe_values.JxW (q_index);
+            }
+        }
+
+      cell->get_dof_indices (local_dof_indices);
+      constraints.distribute_local_to_global (cell_residual, local_dof_indices, residual);
+    }
+}
+
+
+
+template <int dim>
+double Burger<dim>::compute_explicit_time_step () const
+{
+  // Convective limit h / |u|_max and diffusive limit h^2 / (2 dim nu), both
+  // with the smallest cell of the mesh and scaled by the CFL number.
+  const double h_min = GridTools::minimal_cell_diameter (triangulation) / std::sqrt (1.*dim);
+
+  double u_max = 0;
+  Vector<double> cell_values (fe.dofs_per_cell);
+  typename DoFHandler<dim>::active_cell_iterator
+  cell = dof_handler.begin_active(),
+  endc = dof_handler.end();
+  for (; cell!=endc; ++cell)
+    {
+      cell->get_dof_values (old_solution, cell_values);
+      for (unsigned int k=0; k<fe.base_element(0).dofs_per_cell; ++k)
+        {
+          double velocity_square = 0;
+          for (unsigned int c=0; c<dim; ++c)
+            {
+              const double value = cell_values (fe.component_to_system_index (c, k));
+              velocity_square += value * value;
+            }
+          u_max = std::max (u_max, std::sqrt (velocity_square));
+        }
+    }
+
+  const double diffusive_step = h_min * h_min / (2. * dim * nu);
+  if (u_max == 0)
+    return cfl_number * diffusive_step;
+
+  return cfl_number * std::min (h_min / u_max, diffusive_step);
+}
+
+
+
+template <int dim>
+void Burger<dim>::explicit_step (const double max_time_step)
+{
+  // Third order strong stability preserving Runge-Kutta scheme of Shu and
+  // Osher, one residual evaluation and one diagonal scaling per stage.
+  // The step is the CFL limited one, shortened to max_time_step.
+  time_step = std::min (compute_explicit_time_step (), max_time_step);
+  pcout << "   Explicit time step " << time_step << std::endl;
+
+  Vector<double> stage (old_solution.size());
+  Vector<double> residual (old_solution.size());
+
+  // u1 = u + dt L(u)
+  assemble_residual (old_solution, time, residual);
+  residual.scale (inverse_lumped_mass);
+  stage = old_solution;
+  stage.add (time_step, residual);
+  constraints.distribute (stage);
+
+  // u2 = 3/4 u + 1/4 (u1 + dt L(u1))
+  assemble_residual (stage, time + time_step, residual);
+  residual.scale (inverse_lumped_mass);
+  stage.add (time_step, residual);
+  stage.sadd (0.25, 0.75, old_solution);
+  constraints.distribute (stage);
+
+  // u^{n+1} = 1/3 u + 2/3 (u2 + dt L(u2))
+  assemble_residual (stage, time + 0.5*time_step, residual);
+  residual.scale (inverse_lumped_mass);
+  stage.add (time_step, residual);
+  solution = old_solution;
+  solution.sadd (1./3., 2./3., stage);
+  constraints.distribute (solution);
+}
+
+
+
+template <int dim>
+std::string Burger<dim>::linear_solver_name (const LinearSolverType type)
+{
+  switch (type)
+    {
+    case gmres:       return "GMRES";
+    case fused_gmres: return "fused GMRES";
+    case recycling_gmres: return "recycling GMRES";
+    case direct_umfpack: return "UMFPACK";
+    default:          return "unknown";
+    }
+}
+
+
+
+template <int dim>
+template <class PreconditionerType>
+unsigned int Burger<dim>::solve_krylov (const LinearSolverType    linear_solver_type,
+                                        Vector<double>           &x,
+                                        const PreconditionerType &preconditioner)
+{
+	int    vel_max_its     = 5000;
+	double vel_eps         = 1e-9;
+	int    vel_Krylov_size = krylov_basis_size;
+
+	SolverControl solver_control (vel_max_its, vel_eps*system_rhs.l2_norm());
+	switch (linear_solver_type)
+	  {
+	  case gmres:
+	    {
+		  SolverGMRES<Vector<double>> gmres1 (solver_control, vector_memory,
+						   SolverGMRES<>::AdditionalData (vel_Krylov_size));
+		  gmres1.solve (system_matrix, x, system_rhs, preconditioner);
+		  break;
+	    }
+	  case fused_gmres:
+	    {
+		  SolverFusedGMRES gmres1 (solver_control, fused_gmres_workspace,
+						   SolverFusedGMRES::AdditionalData (vel_Krylov_size));
+		  gmres1.solve (system_matrix, x, system_rhs, preconditioner);
+		  break;
+	    }
+	  case recycling_gmres:
+	    {
+		  SolverRecyclingGMRES gmres1 (solver_control, recycle_space,
+						   SolverRecyclingGMRES::AdditionalData (vel_Krylov_size));
+		  gmres1.solve (system_matrix, x, system_rhs, preconditioner);
+		  break;
+	    }
+	  default:
+	    Assert (false, ExcNotImplemented());
+	  }
+
+  last_linear_residual = solver_control.last_value();
+  return solver_control.last_step();
+}
+
+
+
+template <int dim>
+template <class SmootherType>
+unsigned int
+Burger<dim>::solve_krylov_multigrid (const LinearSolverType                      linear_solver_type,
+                                     Vector<double>                             &x,
+                                     const MGTransferPrebuilt<Vector<double> >  &mg_transfer,
+                                     const MGCoarseGridHouseholder<>            &coarse_grid_solver,
+                                     const SmootherType                         &mg_smoother)
+{
+  // The level operators only enter through mg::Matrix, i.e. through
+  // vmult/Tvmult on each level, so a matrix-free level operator can take
+  // the place of mg_matrices without changing the cycle.
+  mg::Matrix<> mg_matrix (mg_matrices);
+  mg::Matrix<> mg_edge_down (mg_interface_down);
+  mg::Matrix<> mg_edge_up (mg_interface_up);
+
+  Multigrid<Vector<double> > mg (dof_handler,
+                                 mg_matrix,
+                                 coarse_grid_solver,
+                                 mg_transfer,
+                                 mg_smoother,
+                                 mg_smoother);
+  mg.set_edge_matrices (mg_edge_down, mg_edge_up);
+
+  PreconditionMG<dim, Vector<double>, MGTransferPrebuilt<Vector<double> > >
+  preconditioner (dof_handler, mg, mg_transfer);
+
+  return solve_krylov (linear_solver_type, x, preconditioner);
+}
+
+
+
+template <int dim>
+unsigned int Burger<dim>::solve_with (const LinearSolverType linear_solver_type,
+                                      Vector<double>        &x,
+                                      double                &wall_time)
+{
+  // The region is here rather than in solve(), so that the Newton updates
+  // of run_steady() and the solver comparison are counted as well.
+  BURGER_PERF_REGION ("solve");
+
+  Timer timer;
+  timer.start ();
+
+  if (linear_solver_type == direct_umfpack)
+    {
+      // UMFPACK chooses a fill-reducing column ordering (COLAMD/AMD) during
+      // the symbolic factorization. The factorization is kept until
+      // system_matrix is reassembled, which with imex_bdf2 only happens
+      // after refine_grid().
+      if (!factorization_up_to_date)
+        {
+          direct_solver.initialize (system_matrix);
+          factorization_up_to_date = true;
+        }
+      direct_solver.vmult (x, system_rhs);
+      last_linear_residual = 0;
+
+      timer.stop ();
+      wall_time = timer.wall_time ();
+      return 0;
+    }
+
+  unsigned int n_iterations = 0;
+  switch (preconditioner_type)
+    {
+    case ssor_preconditioner:
+      {
+        // Kept between solves, and only rebuilt when system_matrix has
+        // been reassembled.
+        if (!preconditioner_up_to_date)
+          {
+            ssor.initialize(system_matrix, 1.0);
+            preconditioner_up_to_date = true;
+          }
+
+        n_iterations = solve_krylov (linear_solver_type, x, ssor);
+        break;
+      }
+
+    case multigrid_preconditioner:
+      {
+        MGTransferPrebuilt<Vector<double> > mg_transfer (hanging_node_constraints,
+                                                         mg_constrained_dofs);
+        mg_transfer.build_matrices (dof_handler);
+
+        FullMatrix<double> coarse_matrix;
+        coarse_matrix.copy_from (mg_matrices[0]);
+        MGCoarseGridHouseholder<> coarse_grid_solver;
+        coarse_grid_solver.initialize (coarse_matrix);
+
+        const unsigned int n_levels = triangulation.n_levels();
+
+        if (mg_smoother_type == chebyshev_smoother)
+          {
+            // The eigenvalue estimate of the Chebyshev smoother uses CG and
+            // is therefore only approximate for the nonsymmetric operator;
+            // the smoothing range leaves room for that.
+            typedef PreconditionChebyshev<SparseMatrix<double>, Vector<double> > Smoother;
+            MGLevelObject<typename Smoother::AdditionalData> smoother_data;
+            smoother_data.resize (0, n_levels-1);
+            for (unsigned int level=0; level<n_levels; ++level)
+              {
+                smoother_data[level].smoothing_range     = 15.;
+                smoother_data[level].degree              = mg_smoothing_steps;
+                smoother_data[level].eig_cg_n_iterations = 10;
+              }
+
+            MGSmootherPrecondition<SparseMatrix<double>, Smoother, Vector<double> >
+            mg_smoother;
+            mg_smoother.initialize (mg_matrices, smoother_data);
+
+            n_iterations = solve_krylov_multigrid (linear_solver_type, x,
+                                                   mg_transfer, coarse_grid_solver,
+                                                   mg_smoother);
+          }
+        else
+          {
+            typedef PreconditionJacobi<SparseMatrix<double> > Smoother;
+            MGSmootherPrecondition<SparseMatrix<double>, Smoother, Vector<double> >
+            mg_smoother;
+            mg_smoother.initialize (mg_matrices, Smoother::AdditionalData (0.6));
+            mg_smoother.set_steps (mg_smoothing_steps);
+
+            n_iterations = solve_krylov_multigrid (linear_solver_type, x,
+                                                   mg_transfer, coarse_grid_solver,
+                                                   mg_smoother);
+          }
+        break;
+      }
+
+    default:
+      Assert (false, ExcNotImplemented());
+    }
+
+  timer.stop ();
+  wall_time = timer.wall_time ();
+
+  return n_iterations;
+}
+
+
+
+template <int dim>
+void Burger<dim>::compute_initial_guess ()
+{
+  // Called after assembly: the Dirichlet values are homogeneous, so every
+  // guess built from previous solutions is consistent with the rows
+  // MatrixTools::apply_boundary_values has replaced.
+  switch (initial_guess)
+    {
+    case zero_guess:
+      solution = 0;
+      break;
+
+    case previous_solution_guess:
+      solution = old_solution;
+      break;
+
+    case extrapolated_guess:
+      // Linear extrapolation 2 u^n - u^{n-1}; at the first step of a
+      // run there is no u^{n-1} yet.
+      if (timestep_number == 0)
+        solution = old_solution;
+      else
+        {
+          solution.equ (2.0, old_solution);
+          solution.add (-1.0, old_old_solution);
+        }
+      break;
+
+    case projected_guess:
+    {
+      // Minimize |b - A x| over the span of the last converged solutions.
+      // A X is orthonormalized by modified Gram-Schmidt, keeping track of
+      // the triangular factor R, so that x = X R^{-1} Q^T b.
+      const unsigned int k = guess_history.size();
+      solution = 0;
+      if (k == 0)
+        {
+          solution = old_solution;
+          break;
+        }
+
+      std::vector<Vector<double> > Q (k, Vector<double> (solution.size()));
+      FullMatrix<double> R (k, k);
+      std::vector<bool> keep (k, true);
+      for (unsigned int i = 0; i < k; ++i)
+        {
+          system_matrix.vmult (Q[i], guess_history[i]);
+          const double initial_norm = Q[i].l2_norm ();
+          for (unsigned int j = 0; j < i; ++j)
+            if (keep[j])
+              {
+                R(j, i) = Q[j] * Q[i];
+                Q[i].add (-R(j, i), Q[j]);
+              }
+          R(i, i) = Q[i].l2_norm ();
+          if (R(i, i) <= 1e-10 * initial_norm)
+            keep[i] = false;
+          else
+            Q[i] /= R(i, i);
+        }
+
+      std::vector<double> c (k, 0.);
+      for (int i = k - 1; i >= 0; --i)
+        if (keep[i])
+          {
+            double sum = Q[i] * system_rhs;
+            for (unsigned int j = i + 1; j < k; ++j)
+              if (keep[j])
+                sum -= R(i, j) * c[j];
+            c[i] = sum / R(i, i);
+          }
+
+      for (unsigned int i = 0; i < k; ++i)
+        if (keep[i])
+          solution.add (c[i], guess_history[i]);
+      break;
+    }
+
+    default:
+      Assert (false, ExcNotImplemented());
+    }
+}
+
+
+
+template <int dim>
+void Burger<dim>::solve ()
+{
+/*  SolverControl           solver_control (1000, 1e-8 * system_rhs.l2_norm());
+  SolverCG<>              solver (solver_control);
+
+  PreconditionSSOR<> preconditioner;//PreconditionIdentity()
+  preconditioner.initialize(system_matrix, 1.0);
+
+  solver.solve (system_matrix, solution, system_rhs,
+                preconditioner);
+
+*/
+  // When comparing, every other solver starts from the same initial guess
+  // as the selected one, and only the selected solver's result is kept.
+  const Vector<double> comparison_guess (compare_linear_solvers ? solution : Vector<double>());
+
+  double wall_time;
+  const unsigned int n_iterations = solve_with (linear_solver, solution, wall_time);
+  const double       residual     = last_linear_residual;
+  last_linear_iterations = n_iterations;
+
+  if (linear_solver == direct_umfpack)
+    pcout << "   Direct solve with " << dof_handler.n_dofs()
+          << " unknowns." << std::endl;
+  else
+    pcout << "   " << n_iterations
+          << " GMRES iterations needed to obtain convergence."
+          << std::endl;
+
+  if (compare_linear_solvers)
+    {
+      pcout << "      " << std::setw(12) << linear_solver_name (linear_solver)
+            << ": " << std::setw(5) << n_iterations << " iterations, "
+            << wall_time << " s" << std::endl;
+
+      const LinearSolverType all_solvers[] = { gmres, fused_gmres, recycling_gmres, direct_umfpack };
+      for (unsigned int s = 0; s < sizeof(all_solvers)/sizeof(all_solvers[0]); ++s)
+        if (all_solvers[s] != linear_solver)
+          {
+            Vector<double> x (comparison_guess);
+            double other_wall_time;
+            const unsigned int other_iterations = solve_with (all_solvers[s], x, other_wall_time);
+            pcout << "      " << std::setw(12) << linear_solver_name (all_solvers[s])
+                  << ": " << std::setw(5) << other_iterations << " iterations, "
+                  << other_wall_time << " s" << std::endl;
+          }
+      last_linear_residual = residual;
+    }
+
+  constraints.distribute (solution);
+
+  if (initial_guess == projected_guess)
+    {
+      if (guess_history.size() == n_guess_history)
+        guess_history.pop_front ();
+      guess_history.push_back (solution);
+    }
+}
+
+template <int dim>
+void Burger<dim>::estimate_error ()
+{
+	estimated_error_per_cell.reinit (triangulation.n_active_cells());
+
+	KellyErrorEstimator<dim>::estimate(dof_handler,
+			                            QGauss<dim-1>(fe.degree+2),
+			                            typename FunctionMap<dim>::type(),
+			                            solution,
+			                            estimated_error_per_cell);
+}
+
+
+
+template <int dim>
+bool Burger<dim>::remeshing_due ()
+{
+  if (refinement_strategy == fixed_number_strategy)
+    {
+      const bool due = (timestep_number > 0) && (timestep_number % 5 == 0);
+      if (due)
+        estimate_error ();
+      return due;
+    }
+
+  if (timestep_number < last_remesh_step + min_steps_between_remeshing)
+    return false;
+
+  // The indicator of the first check on a new mesh is the reference; the
+  // mesh is adapted again once the indicator has moved away from it by
+  // more than remesh_indicator_change, relative to its norm.
+  estimate_error ();
+  if (reference_error_per_cell.size() != estimated_error_per_cell.size())
+    {
+      reference_error_per_cell = estimated_error_per_cell;
+      return false;
+    }
+
+  Vector<float> change (estimated_error_per_cell);
+  change -= reference_error_per_cell;
+  return (change.l2_norm() > remesh_indicator_change * reference_error_per_cell.l2_norm());
+}
+
+
+
+template <int dim>
+void Burger<dim>::mark_cells_for_refinement ()
+{
+  if (refinement_strategy == fixed_number_strategy)
+    {
+/*
+      GridRefinement::refine_and_coarsen_fixed_number(triangulation,
+                                                      estimated_error_per_cell,
+                                                      0.6, 0.4);
+*/
+      GridRefinement::refine_and_coarsen_fixed_number (triangulation,
+                                                       estimated_error_per_cell,
+                                                       0.5, 0.2);
+      return;
+    }
+
+  const unsigned int n_cells = estimated_error_per_cell.size();
+  std::vector<float> sorted_error (estimated_error_per_cell.begin(),
+                                   estimated_error_per_cell.end());
+  std::sort (sorted_error.begin(), sorted_error.end(), std::greater<float>());
+
+  // Number of cells with the largest and with the smallest indicators that
+  // are to be refined and coarsened, and for the cell budget the number of
+  // parents whose children are to be coarsened.
+  unsigned int n_refine = 0, n_coarsen = 0, n_coarsen_parents = 0;
+  if (refinement_strategy == fixed_fraction_strategy)
+    {
+      const double total_error = std::accumulate (sorted_error.begin(), sorted_error.end(), 0.);
+
+      double sum = 0;
+      while ((n_refine < n_cells) && (sum < refine_fraction * total_error))
+        sum += sorted_error[n_refine++];
+
+      sum = 0;
+      while ((n_coarsen < n_cells - n_refine) &&
+             (sum + sorted_error[n_cells-1-n_coarsen] <= coarsen_fraction * total_error))
+        sum += sorted_error[n_cells-1-n_coarsen++];
+    }
+  else
+    {
+      // Refining a cell adds children-1 cells, and so does coarsening the
+      // children of a parent remove children-1 cells. A share
+      // exchange_fraction of the mesh is always moved to where the
+      // indicator is large; on top of that, cells are refined or parents
+      // coarsened to reach the number of cells that corresponds to
+      // target_n_dofs.
+      const double children      = GeometryInfo<dim>::max_children_per_cell;
+      const double dofs_per_cell = double(dof_handler.n_dofs()) / n_cells;
+      const double target_cells  = target_n_dofs / dofs_per_cell;
+
+      const double refine_cells    = exchange_fraction * n_cells
+                                     + std::max (0., (target_cells - n_cells) / (children - 1));
+      const double coarsen_parents = exchange_fraction * n_cells
+                                     + std::max (0., (n_cells - target_cells) / (children - 1));
+
+      n_refine          = std::min<unsigned int> (refine_cells, n_cells);
+      n_coarsen_parents = coarsen_parents;
+    }
+
+  // Hysteresis: cells that were coarsened by the previous adaptation are
+  // only refined again if their indicator exceeds the refinement threshold
+  // by the factor 1+refinement_hysteresis, and recently refined cells are
+  // only coarsened below 1-refinement_hysteresis times the coarsening
+  // threshold. This keeps cells near a threshold from flip-flopping.
+  const double refine_threshold  = (n_refine > 0 ? sorted_error[n_refine-1]
+                                                 : std::numeric_limits<double>::max());
+  const double coarsen_threshold = (n_coarsen > 0 ? sorted_error[n_cells-n_coarsen]
+                                                  : -1.);
+
+  unsigned int index = 0;
+  for (typename Triangulation<dim>::active_cell_iterator
+       cell = triangulation.begin_active(); cell != triangulation.end(); ++cell, ++index)
+    {
+      const double eta = estimated_error_per_cell(index);
+      const bool   recently_refined   = (cell->user_index() == 1);
+      const bool   recently_coarsened = (cell->user_index() == 2);
+
+      if (eta >= refine_threshold * (recently_coarsened ? 1. + refinement_hysteresis : 1.))
+        cell->set_refine_flag ();
+      else if (eta <= coarsen_threshold * (recently_refined ? 1. - refinement_hysteresis : 1.))
+        cell->set_coarsen_flag ();
+    }
+
+  if (n_coarsen_parents == 0)
+    return;
+
+  // The triangulation only coarsens a parent if all of its children are
+  // flagged, so the cell budget plans the coarsening per parent. The
+  // candidates are the parents whose children are all active and none
+  // flagged for refinement, ranked by the sum of the children's
+  // indicators; the same hysteresis as above applies to the parents of
+  // recently refined cells.
+  struct ParentIndicator
+  {
+    ParentIndicator () : eta (0), n_active_children (0), recently_refined (false), refined (false) {}
+
+    double       eta;
+    unsigned int n_active_children;
+    bool         recently_refined;
+    bool         refined;
+  };
+  std::map<typename Triangulation<dim>::cell_iterator, ParentIndicator> parents;
+
+  index = 0;
+  for (typename Triangulation<dim>::active_cell_iterator
+       cell = triangulation.begin_active(); cell != triangulation.end(); ++cell, ++index)
+    if (cell->level() > 0)
+      {
+        ParentIndicator &parent = parents[cell->parent()];
+        parent.eta += estimated_error_per_cell(index);
+        ++parent.n_active_children;
+        parent.recently_refined = parent.recently_refined || (cell->user_index() == 1);
+        parent.refined          = parent.refined || cell->refine_flag_set();
+      }
+
+  std::vector<std::pair<double, typename Triangulation<dim>::cell_iterator> > candidates;
+  for (typename std::map<typename Triangulation<dim>::cell_iterator, ParentIndicator>::const_iterator
+       parent = parents.begin(); parent != parents.end(); ++parent)
+    if ((parent->second.n_active_children == parent->first->n_children()) && !parent->second.refined)
+      candidates.push_back (std::make_pair (parent->second.eta, parent->first));
+  if (candidates.empty())
+    return;
+
+  n_coarsen_parents = std::min<unsigned int> (n_coarsen_parents, candidates.size());
+  std::nth_element (candidates.begin(), candidates.begin() + (n_coarsen_parents-1), candidates.end());
+  const double parent_threshold = candidates[n_coarsen_parents-1].first;
+
+  for (unsigned int i=0; i<n_coarsen_parents; ++i)
+    if (candidates[i].first <= parent_threshold * (parents[candidates[i].second].recently_refined
+                                                   ? 1. - refinement_hysteresis : 1.))
+      for (unsigned int c=0; c<candidates[i].second->n_children(); ++c)
+        candidates[i].second->child(c)->set_coarsen_flag ();
+}
+
+
+
+template <int dim>
+void Burger<dim>::refine_grid(const unsigned int min_grid_level,
+		                     const unsigned int max_grid_level){
+	BURGER_PERF_REGION ("refine");
+
+	// Uses the indicator from the last call of estimate_error().
+	Assert (estimated_error_per_cell.size() == triangulation.n_active_cells(),
+	        ExcDimensionMismatch (estimated_error_per_cell.size(), triangulation.n_active_cells()));
+
+	mark_cells_for_refinement ();
+
+	if(triangulation.n_levels() > max_grid_level){
+		for(typename Triangulation<dim>::active_cell_iterator
+				cell = triangulation.begin_active(max_grid_level);
+				cell != triangulation.end(); ++cell){
+			cell->clear_refine_flag();
+		}
+	}
+	for(typename Triangulation<dim>::active_cell_iterator
+			cell = triangulation.begin_active(min_grid_level);
+			cell != triangulation.end_active(min_grid_level); ++cell)
+		cell->clear_coarsen_flag();
+
+	SolutionTransfer<dim> solution_transfer(dof_handler);
+
+	// Besides the solution, the previous time level, the history used
+	// for the initial guess of the next linear solve and the recycled
+	// Krylov directions are carried over.
+	const unsigned int n_guesses = guess_history.size();
+	std::vector<Vector<double> > previous_solution (2 + n_guesses + recycle_space.size());
+	previous_solution[0] = solution;
+	previous_solution[1] = old_solution;
+	for (unsigned int i = 0; i < n_guesses; ++i)
+	  previous_solution[2 + i] = guess_history[i];
+	for (unsigned int i = 0; i < recycle_space.size(); ++i)
+	  previous_solution[2 + n_guesses + i] = recycle_space[i];
+
+
+	triangulation.prepare_coarsening_and_refinement();
+	solution_transfer.prepare_for_coarsening_and_refinement(previous_solution);
+
+	// Remember where the mesh changes, for the hysteresis of the next
+	// adaptation: the cells that get refined, and the parents of cells
+	// that get coarsened.
+	std::vector<typename Triangulation<dim>::cell_iterator> refined_cells, coarsened_parents;
+	for (typename Triangulation<dim>::active_cell_iterator
+	     cell = triangulation.begin_active(); cell != triangulation.end(); ++cell)
+	  if (cell->refine_flag_set())
+	    refined_cells.push_back (cell);
+	for (typename Triangulation<dim>::cell_iterator
+	     cell = triangulation.begin(); cell != triangulation.end(); ++cell)
+	  if (cell->has_children() && cell->child(0)->active() && cell->child(0)->coarsen_flag_set())
+	    coarsened_parents.push_back (cell);
+
+	// The probe lookup lives on the old mesh.
+	analysis.invalidate ();
+
+
+	triangulation.execute_coarsening_and_refinement();
+	cell_locator.update ();
+	setup_system();
+
+	triangulation.clear_user_data ();
+	for (unsigned int i = 0; i < refined_cells.size(); ++i)
+	  for (unsigned int c = 0; c < refined_cells[i]->n_children(); ++c)
+	    refined_cells[i]->child(c)->set_user_index (1);
+	for (unsigned int i = 0; i < coarsened_parents.size(); ++i)
+	  coarsened_parents[i]->set_user_index (2);
+
+	last_remesh_step = timestep_number;
+	reference_error_per_cell.reinit (0);
+
+	std::vector<Vector<double> > transferred_solution (previous_solution.size(),
+	                                                   Vector<double> (dof_handler.n_dofs()));
+	solution_transfer.interpolate(previous_solution, transferred_solution);
+
+	solution     = transferred_solution[0];
+	old_solution = transferred_solution[1];
+	for (unsigned int i = 0; i < n_guesses; ++i)
+	  guess_history[i] = transferred_solution[2 + i];
+	for (unsigned int i = 0; i < recycle_space.size(); ++i)
+	  recycle_space[i] = transferred_solution[2 + n_guesses + i];
+
+	constraints.distribute(solution);
+	constraints.distribute(old_solution);
+	for (unsigned int i = 0; i < n_guesses; ++i)
+	  constraints.distribute(guess_history[i]);
+	for (unsigned int i = 0; i < recycle_space.size(); ++i)
+	  constraints.distribute(recycle_space[i]);
+
+	print_memory_report ();
+
+}
+
+
+
+template <int dim>
+std::size_t Burger<dim>::preconditioner_memory_consumption () const
+{
+  if (preconditioner_type == multigrid_preconditioner)
+    {
+      // Level matrices and patterns are persistent; the prolongation
+      // matrices of MGTransferPrebuilt have about the size of one level
+      // sparsity pattern per level.
+      std::size_t bytes = 0;
+      for (unsigned int level=mg_matrices.min_level(); level<=mg_matrices.max_level(); ++level)
+        bytes += mg_matrices[level].memory_consumption ()
+                 + mg_interface_down[level].memory_consumption ()
+                 + mg_interface_up[level].memory_consumption ()
+                 + 2 * mg_sparsity_patterns[level].memory_consumption ();
+      return bytes + hanging_node_constraints.memory_consumption ()
+             + mg_constrained_dofs.memory_consumption ();
+    }
+
+  // PreconditionSSOR keeps the position right of the diagonal for every row.
+  return sizeof (PreconditionSSOR<>)
+         + system_matrix.m() * sizeof (SparseMatrix<double>::size_type);
+}
+
+
+
+template <int dim>
+std::size_t Burger<dim>::krylov_workspace_memory_consumption () const
+{
+  // Basis plus auxiliary vectors the selected solver allocates during a
+  // solve; the recycled space of SolverRecyclingGMRES is counted separately.
+  const std::size_t vector_bytes = solution.size() * sizeof (double);
+  switch (linear_solver)
+    {
+    case gmres:
+      return (krylov_basis_size + 2) * vector_bytes;
+    case fused_gmres:
+      return (krylov_basis_size + 1 + 2) * vector_bytes;
+    case recycling_gmres:
+      return (krylov_basis_size + 1 + 3 + recycle_space.size()) * vector_bytes;
+    case direct_umfpack:
+      return 0;
+    default:
+      return 0;
+    }
+}
+
+
+
+template <int dim>
+void Burger<dim>::print_memory_report ()
+{
+  std::vector<std::pair<std::string, std::size_t> > entries;
+  entries.push_back (std::make_pair ("triangulation",    triangulation.memory_consumption ()));
+  entries.push_back (std::make_pair ("dof_handler",      dof_handler.memory_consumption ()));
+  entries.push_back (std::make_pair ("constraints",      constraints.memory_consumption ()));
+  entries.push_back (std::make_pair ("sparsity_pattern", sparsity_pattern.memory_consumption ()));
+  entries.push_back (std::make_pair ("system_matrix",    system_matrix.memory_consumption ()));
+  entries.push_back (std::make_pair ("solution",         solution.memory_consumption ()));
+  entries.push_back (std::make_pair ("old_solution",     old_solution.memory_consumption ()));
+  entries.push_back (std::make_pair ("old_old_solution", old_old_solution.memory_consumption ()));
+  entries.push_back (std::make_pair ("system_rhs",       system_rhs.memory_consumption ()));
+
+  std::size_t history_bytes = 0;
+  for (unsigned int i=0; i<guess_history.size(); ++i)
+    history_bytes += guess_history[i].memory_consumption ();
+  entries.push_back (std::make_pair ("guess_history", history_bytes));
+
+  entries.push_back (std::make_pair ("recycle_space", MemoryConsumption::memory_consumption (recycle_space)));
+  entries.push_back (std::make_pair ("preconditioner",   preconditioner_memory_consumption ()));
+  entries.push_back (std::make_pair ("krylov_workspace", krylov_workspace_memory_consumption ()));
+
+  std::size_t total = 0;
+  for (unsigned int i=0; i<entries.size(); ++i)
+    total += entries[i].second;
+
+  // VmRSS and VmHWM are reported in kB by the kernel.
+  Utilities::System::MemoryStats stats;
+  Utilities::System::get_memory_stats (stats);
+  const std::size_t rss = std::size_t(stats.VmRSS) * 1024;
+  peak_rss = std::max (peak_rss, std::max (rss, std::size_t(stats.VmHWM) * 1024));
+
+  pcout << "   Memory (timestep " << timestep_number << ", "
+        << dof_handler.n_dofs() << " DoFs):" << std::endl;
+  for (unsigned int i=0; i<entries.size(); ++i)
+    pcout << "      " << std::setw(18) << std::left << entries[i].first << std::right
+          << std::setw(12) << entries[i].second << " bytes" << std::endl;
+  pcout << "      " << std::setw(18) << std::left << "total" << std::right
+        << std::setw(12) << total << " bytes" << std::endl
+        << "      " << std::setw(18) << std::left << "rss" << std::right
+        << std::setw(12) << rss << " bytes" << std::endl
+        << "      " << std::setw(18) << std::left << "peak rss" << std::right
+        << std::setw(12) << peak_rss << " bytes" << std::endl;
+
+  // One JSON object per line, so that the file can be appended to and
+  // read incrementally.
+  if (memory_out.is_open())
+    {
+      memory_out << "{\"timestep\": " << timestep_number
+                 << ", \"time\": " << time
+                 << ", \"n_dofs\": " << dof_handler.n_dofs()
+                 << ", \"n_active_cells\": " << triangulation.n_active_cells();
+      for (unsigned int i=0; i<entries.size(); ++i)
+        memory_out << ", \"" << entries[i].first << "\": " << entries[i].second;
+      memory_out << ", \"total\": " << total
+                 << ", \"rss\": " << rss
+                 << ", \"peak_rss\": " << peak_rss
+                 << "}\n";
+      memory_out.flush ();
+    }
+}
+
+
+
+template <int dim>
+void Burger<dim>::output_results () const
+{
+    BURGER_PERF_REGION ("output");
+
+    // Probes and global quantities are taken every time step by analysis;
+    // the full field only every snapshot_interval steps, or never if it
+    // is zero.
+    if ((snapshot_interval == 0) || (timestep_number % snapshot_interval != 0))
+      return;
+    /*
+    DataOut<dim> data_out;
+    data_out.attach_dof_handler(dof_handler);
+    data_out.add_data_vector(solution, "velocity");
+    data_out.build_patches();
+    const std::string filename = "solution-"
+                                 + Utilities::int_to_string(timestep_number, 3) +
+                                 ".vtk";
+    std::ofstream output(filename.c_str());
+    data_out.write_vtk(output);
+
+ */
+
+    std::vector<std::string> solution_names (dim, "velocity");
+
+    std::vector<DataComponentInterpretation::DataComponentInterpretation>
+    data_component_interpretation
+    (dim, DataComponentInterpretation::component_is_part_of_vector);
+
+    DataOut<dim> data_out;
+    data_out.attach_dof_handler (dof_handler);
+    data_out.add_data_vector (solution, solution_names,
+                              DataOut<dim>::type_dof_data,
+                              data_component_interpretation);
+    data_out.build_patches ();
+    std::ostringstream filename;
+    filename << output_prefix << "solution-"
+             << Utilities::int_to_string (timestep_number, 3)
+             << ".vtk";
+    std::ofstream output (filename.str().c_str());
+    data_out.write_vtk (output);
+}
+
+
+
+
+template <int dim>
+void Burger<dim>::run ()
+{
+  pcout << "Solving problem in " << dim << " space dimensions." << std::endl;
+
+  diagnostics.open (output_prefix + "diagnostics.bin");
+  analysis.open (output_prefix + "analysis.dat");
+  memory_out.open ((output_prefix + "memory.jsonl").c_str());
+
+
+  make_grid();
+  cell_locator.update ();
+  setup_system ();
+  print_memory_report ();
+  const BubbleGauss<dim> bubble_gum;
+  unsigned int pre_refinement_step = 0;
+  const unsigned int n_adaptive_pre_refinement_steps = 4;
+  const unsigned int initial_global_refinement = 2;
+
+  double L2_error ;
+  Timer phase_timer;
+  dofs_range = std::make_pair (std::numeric_limits<types::global_dof_index>::max(),
+                               types::global_dof_index (0));
+
+
+start_time_iteration:
+
+  timestep_number = 0;
+  time            = 0;
+  guess_history.clear ();
+  recycle_space.clear ();
+
+  /*
+  VectorTools::interpolate(dof_handler,
+		  	  	  	       ZeroFunction<dim>(dim),
+                           old_solution);
+
+*/
+  VectorTools::project (dof_handler,
+                        constraints,
+                        QGauss<dim>(fe.degree+1),
+                        ZeroFunction<dim>(dim),//bubble_gum,
+                        old_solution);
+
+  solution = old_solution;
+  output_results();
+//  old_solution = 0;
+//  solution     = 0;
+
+   do{
+
+      pcout << "Time step " << timestep_number << " at t=" << time
+            << std::endl;
+
+      DiagnosticsLog::Record record;
+      const std::size_t n_allocations_before = AllocationCounter::n_allocations ();
+      phase_timer.restart ();
+
+      if (time_integration == explicit_ssp_rk3)
+        {
+          explicit_step ();
+          last_linear_iterations = 0;
+          last_linear_residual   = 0;
+          record.assembly_time   = 0;
+        }
+      else
+        {
+          if (time_integration == imex_bdf2)
+            {
+              const bool matrix_changed = assemble_imex_system ();
+              if (matrix_changed && (preconditioner_type == multigrid_preconditioner))
+                assemble_multigrid ();
+            }
+          else
+            {
+              assemble_system_2 ();
+              if (preconditioner_type == multigrid_preconditioner)
+                assemble_multigrid ();
+            }
+          compute_initial_guess ();
+
+          record.assembly_time = phase_timer.wall_time ();
+          phase_timer.restart ();
+          solve ();
+        }
+      record.solve_time        = phase_timer.wall_time ();
+      record.linear_iterations = last_linear_iterations;
+      record.linear_residual   = last_linear_residual;
+      record.n_dofs            = dof_handler.n_dofs ();
+      record.n_cells           = triangulation.n_active_cells ();
+
+      // Until the last pre-refinement step, the time loop is restarted on
+      // the new mesh after step 1, so these steps are not part of the
+      // analysed time series.
+      const bool pre_refinement_due = (timestep_number == 1) &&
+                                      (pre_refinement_step < n_adaptive_pre_refinement_steps);
+      if (pre_refinement_step == n_adaptive_pre_refinement_steps)
+        {
+          analysis.evaluate (dof_handler, cell_locator, solution, time + time_step);
+          dofs_range.first  = std::min (dofs_range.first, dof_handler.n_dofs());
+          dofs_range.second = std::max (dofs_range.second, dof_handler.n_dofs());
+        }
+      output_results ();
+      phase_timer.restart ();
+
+      if(pre_refinement_due){
+
+    	  estimate_error ();
+    	  refine_grid(initial_global_refinement,
+    			  initial_global_refinement + n_adaptive_pre_refinement_steps);
+    	  ++pre_refinement_step;
+    	  old_old_solution.reinit(solution.size());
+    	  old_solution.reinit(solution.size());
+    	  system_rhs.reinit(solution.size());
+
+    	  goto start_time_iteration;
+
+      }
+      else if (remeshing_due ()){
+
+    	  refine_grid(initial_global_refinement,
+    			  initial_global_refinement + n_adaptive_pre_refinement_steps);
+      }
+      record.refinement_time = phase_timer.wall_time ();
+      time += time_step;
+      ++timestep_number;
+
+      L2_error = compute_l2_error ();
+
+      record.time          = time;
+      record.l2_error      = L2_error;
+      record.n_allocations = (AllocationCounter::enabled ()
+                              ? AllocationCounter::n_allocations () - n_allocations_before
+                              : DiagnosticsLog::not_counted);
+      diagnostics.add (record);
+
+      old_old_solution = old_solution;
+      old_solution = solution;
+  }while (time <= 1.0);
+
+  diagnostics.flush ();
+
+}
+
+
+
+template <int dim>
+double Burger<dim>::assemble_steady_system ()
+{
+  BURGER_PERF_REGION ("assembly");
+
+  // Newton step for the stationary problem (u.grad) u - nu laplace u = f
+  // with the manufactured forcing: system_rhs is the negative residual
+  // -R(u) and system_matrix the Jacobian
+  //   J v = (v.grad) u + (u.grad) v - nu laplace v.
+  // Returns |R(u)|.
+  const BubbleGauss<dim> right_hand_side;
+
+  system_matrix = 0;
+  system_rhs    = 0;
+  preconditioner_up_to_date = false;
+  factorization_up_to_date  = false;
+
+  FEValues<dim> &fe_values = scratch.fe_values;
+
+  const unsigned int   dofs_per_cell = fe.dofs_per_cell;
+  const unsigned int   n_q_points    = scratch.quadrature_formula.size();
+
+  FullMatrix<double>   &cell_matrix = scratch.cell_matrix;
+  Vector<double>       &cell_rhs    = scratch.cell_rhs;
+
+  std::vector<Tensor<1, dim> > u_values (n_q_points);
+  std::vector<Tensor<2, dim> > u_gradients (n_q_points);
+  std::vector<Tensor<1, dim> > linearized_convection (dofs_per_cell);
+  Vector<double>               rhs_value (dim);
+
+  const FEValuesExtractors::Vector velocities (0);
+
+  typename DoFHandler<dim>::active_cell_iterator
+  cell = dof_handler.begin_active(),
+  endc = dof_handler.end();
+
+  for (; cell!=endc; ++cell)
+    {
+      fe_values.reinit (cell);
+      const FEValuesViews::Vector<dim>& fe_vector_values = fe_values[velocities];
+
+      fe_vector_values.get_function_values (solution, u_values);
+      fe_vector_values.get_function_gradients (solution, u_gradients);
+
+      cell_matrix = 0;
+      cell_rhs    = 0;
+
+      for (unsigned int q_index=0; q_index<n_q_points; ++q_index)
+        {
+          const Tensor<1, dim> &u      = u_values[q_index];
+          const Tensor<2, dim> &u_grad = u_gradients[q_index];
+
+          Tensor<1, dim> convection, f;
+          right_hand_side.vector_value (fe_values.quadrature_point (q_index), rhs_value);
+          for (unsigned int c=0; c<dim; ++c)
+            {
+              f[c] = rhs_value(c);
+              for (unsigned int d=0; d<dim; ++d)
+                convection[c] += u_grad[c][d] * u[d];
+            }
+
+          // (v.grad) u + (u.grad) v for every shape function v.
+          for (unsigned int j=0; j<dofs_per_cell; ++j)
+            {
+              const Tensor<1, dim> &v      = fe_vector_values.value (j, q_index);
+              const Tensor<2, dim> &v_grad = fe_vector_values.gradient (j, q_index);
+              linearized_convection[j] = 0;
+              for (unsigned int c=0; c<dim; ++c)
+                for (unsigned int d=0; d<dim; ++d)
+                  linearized_convection[j][c] += u_grad[c][d] * v[d] + v_grad[c][d] * u[d];
+            }
+
+          const double JxW = fe_values.JxW (q_index);
+          for (unsigned int i=0; i<dofs_per_cell; ++i)
+            {
+              const Tensor<1, dim> &phi_i      = fe_vector_values.value (i, q_index);
+              const Tensor<2, dim> &grad_phi_i = fe_vector_values.gradient (i, q_index);
+
+              for (unsigned int j=0; j<dofs_per_cell; ++j)
+                cell_matrix(i,j) += ( linearized_convection[j] * phi_i
+                                      +
+                                      nu * double_contract (fe_vector_values.gradient (j, q_index), grad_phi_i)
+                                    ) * JxW;
+
+              cell_rhs(i) -= ( (convection - f) * phi_i
+                               +
+                               nu * double_contract (u_grad, grad_phi_i)
+                             ) * JxW;
+            }
+        }
+
+      cell->get_dof_indices (scratch.local_dof_indices);
+      constraints.distribute_local_to_global (cell_matrix,
+                                              cell_rhs,
+                                              scratch.local_dof_indices,
+                                              system_matrix,
+                                              system_rhs);
+    }
+
+  return system_rhs.l2_norm ();
+}
+
+
+
+template <int dim>
+unsigned int Burger<dim>::solve_steady_state ()
+{
+  // Pseudo-transient continuation with switched evolution relaxation: the
+  // pseudo time step grows with the ratio of successive residual norms,
+  // dtau_k = dtau_{k-1} |R_{k-1}| / |R_k|, so that the iteration starts
+  // as damped implicit Euler steps far from the solution and turns into
+  // Newton's method as the residual drops.
+  AssertThrow (preconditioner_type != multigrid_preconditioner,
+               ExcMessage ("The multigrid levels discretize the transient "
+                           "operator; use SSOR or the direct solver."));
+
+  assemble_lumped_mass_matrix ();
+
+  Vector<double> newton_update (dof_handler.n_dofs());
+  double pseudo_time_step  = initial_pseudo_time_step;
+  double pseudo_time       = 0;
+  double initial_residual  = 0;
+  double previous_residual = 0;
+  Timer  phase_timer;
+
+  for (unsigned int iteration=0; iteration<max_nonlinear_iterations; ++iteration)
+    {
+      DiagnosticsLog::Record record;
+      const std::size_t n_allocations_before = AllocationCounter::n_allocations ();
+      phase_timer.restart ();
+
+      const double residual = assemble_steady_system ();
+      if (iteration == 0)
+        initial_residual = residual;
+      else
+        pseudo_time_step = std::min (pseudo_time_step * previous_residual / residual,
+                                     max_pseudo_time_step);
+      previous_residual = residual;
+
+      pcout << "   Newton iteration " << iteration
+            << ": residual " << residual
+            << ", pseudo time step " << pseudo_time_step << std::endl;
+
+      if ((residual <= steady_residual_tolerance * initial_residual) ||
+          (residual < 1e-14))
+        return iteration;
+
+      // The pseudo time derivative only enters the matrix.
+      for (unsigned int i=0; i<dof_handler.n_dofs(); ++i)
+        if (inverse_lumped_mass(i) > 0)
+          system_matrix.diag_element (i) += 1. / (inverse_lumped_mass(i) * pseudo_time_step);
+      record.assembly_time = phase_timer.wall_time ();
+
+      phase_timer.restart ();
+      newton_update = 0;
+      double wall_time;
+      last_linear_iterations = solve_with (linear_solver, newton_update, wall_time);
+      constraints.distribute (newton_update);
+      solution += newton_update;
+      pseudo_time += pseudo_time_step;
+
+      record.solve_time        = phase_timer.wall_time ();
+      record.refinement_time   = 0;
+      record.time              = pseudo_time;
+      record.l2_error          = compute_l2_error ();
+      record.linear_iterations = last_linear_iterations;
+      record.linear_residual   = last_linear_residual;
+      record.n_dofs            = dof_handler.n_dofs ();
+      record.n_cells           = triangulation.n_active_cells ();
+      record.n_allocations     = (AllocationCounter::enabled ()
+                                  ? AllocationCounter::n_allocations () - n_allocations_before
+                                  : DiagnosticsLog::not_counted);
+      diagnostics.add (record);
+    }
+
+  pcout << "   Steady state not reached in " << max_nonlinear_iterations
+        << " nonlinear iterations." << std::endl;
+  return max_nonlinear_iterations;
+}
+
+
+
+template <int dim>
+void Burger<dim>::run_steady (const unsigned int n_adaptive_refinement_steps)
+{
+  // The manufactured solution of run() directly as a stationary problem,
+  // on the initial mesh and on the adaptively refined meshes of the
+  // pre-refinement cycle. Each mesh starts from the interpolated solution
+  // of the previous one.
+  pcout << "Solving stationary problem in " << dim << " space dimensions." << std::endl;
+
+  diagnostics.open (output_prefix + "diagnostics.bin");
+
+  make_grid ();
+  cell_locator.update ();
+  setup_system ();
+  solution = 0;
+
+  for (unsigned int cycle=0; cycle<=n_adaptive_refinement_steps; ++cycle)
+    {
+      if (cycle > 0)
+        {
+          estimate_error ();
+          refine_grid (n_global_refinements,
+                       n_global_refinements + n_adaptive_refinement_steps);
+        }
+
+      const unsigned int n_iterations = solve_steady_state ();
+
+      timestep_number = cycle;
+      output_results ();
+      pcout << "   Cycle " << cycle << ": " << dof_handler.n_dofs ()
+            << " DoFs, " << n_iterations << " nonlinear iterations, L2 error "
+            << compute_l2_error () << std::endl;
+    }
+
+  diagnostics.flush ();
+}
+
+
+
+template <int dim>
+std::vector<std::pair<std::string, double> >
+Burger<dim>::run_benchmarks (const unsigned int n_repetitions)
+{
+  make_grid ();
+  cell_locator.update ();
+  setup_system ();
+  VectorTools::interpolate (dof_handler, ExactSolution<dim>(), old_solution);
+  old_old_solution = old_solution;
+  solution         = old_solution;
+
+  std::vector<std::pair<std::string, double> > timings;
+  Timer timer;
+
+  // Each kernel is repeated and the fastest run is kept, which is the
+  // least disturbed by other load on the machine.
+  double best = std::numeric_limits<double>::max();
+  for (unsigned int r=0; r<n_repetitions; ++r)
+    {
+      timer.restart ();
+      assemble_system_2 ();
+      best = std::min (best, timer.wall_time ());
+    }
+  timings.push_back (std::make_pair ("assembly_per_cell", best / triangulation.n_active_cells()));
+
+  Vector<double> dst (dof_handler.n_dofs());
+  best = std::numeric_limits<double>::max();
+  for (unsigned int r=0; r<n_repetitions; ++r)
+    {
+      timer.restart ();
+      for (unsigned int k=0; k<10; ++k)
+        system_matrix.vmult (dst, old_solution);
+      best = std::min (best, timer.wall_time () / 10);
+    }
+  timings.push_back (std::make_pair ("spmv", best));
+
+  ssor.initialize (system_matrix, 1.0);
+  preconditioner_up_to_date = true;
+  best = std::numeric_limits<double>::max();
+  for (unsigned int r=0; r<n_repetitions; ++r)
+    {
+      timer.restart ();
+      for (unsigned int k=0; k<10; ++k)
+        ssor.vmult (dst, old_solution);
+      best = std::min (best, timer.wall_time () / 10);
+    }
+  timings.push_back (std::make_pair ("preconditioner_apply", best));
+
+  best = std::numeric_limits<double>::max();
+  for (unsigned int r=0; r<n_repetitions; ++r)
+    {
+      solution = 0;
+      timer.restart ();
+      solve ();
+      best = std::min (best, timer.wall_time ());
+    }
+  timings.push_back (std::make_pair ("gmres_solve", best));
+
+  best = std::numeric_limits<double>::max();
+  for (unsigned int r=0; r<n_repetitions; ++r)
+    {
+      timer.restart ();
+      output_results ();
+      best = std::min (best, timer.wall_time ());
+    }
+  timings.push_back (std::make_pair ("output", best));
+
+  // Changes the mesh, so it comes last and runs once.
+  timer.restart ();
+  estimate_error ();
+  refine_grid (n_global_refinements, n_global_refinements + 1);
+  timings.push_back (std::make_pair ("refine_grid", timer.wall_time ()));
+
+  return timings;
+}
+
+
+
+template <int dim>
+unsigned int Burger<dim>::run_fixed_mesh (const double final_time)
+{
+  make_grid ();
+  cell_locator.update ();
+  setup_system ();
+
+  timestep_number  = 0;
+  time             = 0;
+  old_solution     = 0;
+  old_old_solution = 0;
+  solution         = 0;
+
+  if (time_integration == explicit_ssp_rk3)
+    {
+      // The explicit scheme takes its own CFL limited steps, the last one
+      // shortened to end at final_time.
+      while (time < final_time * (1 - 1e-12))
+        {
+          explicit_step (final_time - time);
+          time += time_step;
+          ++timestep_number;
+          old_old_solution = old_solution;
+          old_solution     = solution;
+        }
+      return 0;
+    }
+
+  unsigned int n_linear_iterations = 0;
+  const unsigned int n_time_steps = static_cast<unsigned int> (final_time / time_step + 0.5);
+  while (timestep_number < n_time_steps)
+    {
+      if (time_integration == imex_bdf2)
+        {
+          const bool matrix_changed = assemble_imex_system ();
+          if (matrix_changed && (preconditioner_type == multigrid_preconditioner))
+            assemble_multigrid ();
+        }
+      else
+        {
+          assemble_system_2 ();
+          if (preconditioner_type == multigrid_preconditioner)
+            assemble_multigrid ();
+        }
+      compute_initial_guess ();
+      solve ();
+      n_linear_iterations += last_linear_iterations;
+
+      time += time_step;
+      ++timestep_number;
+
+      old_old_solution = old_solution;
+      old_solution     = solution;
+    }
+
+  return n_linear_iterations;
+}
+
+
+
+template <int dim>
+std::size_t Burger<dim>::count_time_step_allocations ()
+{
+  // Counts with the settings as they are, so the check runs the defaults:
+  // implicit Euler, SolverFusedGMRES with its persistent workspace, the
+  // SSOR preconditioner and the zero initial guess. A time step without
+  // remeshing and without a snapshot does not allocate with these.
+  // SolverGMRES allocates its Hessenberg arrays in every solve, UMFPACK
+  // and multigrid allocate when they are rebuilt for the new matrix, and
+  // DataOut allocates its patches. The first two steps size the
+  // workspaces and the analysis lookup and write the snapshot of step
+  // zero; the count is taken in the third.
+  analysis.open (output_prefix + "analysis.dat");
+  make_grid ();
+  cell_locator.update ();
+  setup_system ();
+  VectorTools::interpolate (dof_handler, ExactSolution<dim>(), old_solution);
+  old_old_solution = old_solution;
+  timestep_number  = 0;
+  time             = 0;
+
+  std::size_t n_allocations = 0;
+  for (unsigned int step=0; step<3; ++step)
+    {
+      const std::size_t n_allocations_before = AllocationCounter::n_allocations ();
+
+      assemble_system_2 ();
+      compute_initial_guess ();
+      solve ();
+      analysis.evaluate (dof_handler, cell_locator, solution, time + time_step);
+      output_results ();
+      time += time_step;
+      ++timestep_number;
+      compute_l2_error ();
+      old_old_solution = old_solution;
+      old_solution     = solution;
+
+      n_allocations = AllocationCounter::n_allocations () - n_allocations_before;
+    }
+
+  return n_allocations;
+}
+
+
+
+/*
+ * Product of one sparse matrix with several vectors. Every matrix entry is
+ * loaded once and applied to all k vectors, so the bandwidth-bound
+ * matrix traffic of k separate vmult() calls is paid only once.
+ */
+void vmult_batched (const SparseMatrix<double>              &A,
+                    const std::vector<Vector<double> *>       &dst,
+                    const std::vector<const Vector<double> *> &src)
+{
+  Assert (dst.size() == src.size(), ExcDimensionMismatch (dst.size(), src.size()));
+  const unsigned int k = dst.size();
+
+  std::vector<double> sums (k);
+  for (unsigned int row=0; row<A.m(); ++row)
+    {
+      std::fill (sums.begin(), sums.end(), 0.);
+      for (SparseMatrix<double>::const_iterator entry = A.begin(row);
+           entry != A.end(row); ++entry)
+        {
+          const double       value  = entry->value();
+          const unsigned int column = entry->column();
+          for (unsigned int i=0; i<k; ++i)
+            sums[i] += value * (*src[i])(column);
+        }
+      for (unsigned int i=0; i<k; ++i)
+        (*dst[i])(row) = sums[i];
+    }
+}
+
+
+
+/*
+ * BiCGStab for k right hand sides with the same matrix, run in lockstep so
+ * that both matrix-vector products of an iteration are done for all
+ * systems that have not converged yet with one vmult_batched(). Each system
+ * has its own SolverControl and its own scalars; the preconditioner is the
+ * point Jacobi method, given by the inverse diagonal, since that batches
+ * without further matrix traffic.
+ *
+ * As in deal.II's SolverBicgstab, a system whose r_hat.r, r_hat.v or t.t
+ * falls below the breakdown threshold is restarted with its current
+ * residual as the new shadow residual instead of dividing by it; the other
+ * systems of the batch are not affected.
+ */
+class SolverBatchedBiCGStab
+{
+public:
+  SolverBatchedBiCGStab (std::vector<SolverControl> &solver_controls,
+                         const double                breakdown = 1.e-10)
+    :
+    solver_controls (solver_controls),
+    breakdown (breakdown)
+  {}
+
+  void solve (const SparseMatrix<double>                &A,
+              const std::vector<Vector<double> *>       &x,
+              const std::vector<const Vector<double> *> &b,
+              const Vector<double>                      &inverse_diagonal);
+
+private:
+  std::vector<SolverControl> &solver_controls;
+  const double                breakdown;
+};
+
+
+
+void SolverBatchedBiCGStab::solve (const SparseMatrix<double>                &A,
+                                   const std::vector<Vector<double> *>       &x,
+                                   const std::vector<const Vector<double> *> &b,
+                                   const Vector<double>                      &inverse_diagonal)
+{
+  const unsigned int k = x.size();
+  const unsigned int n = inverse_diagonal.size();
+  Assert (solver_controls.size() == k, ExcDimensionMismatch (solver_controls.size(), k));
+
+  std::vector<Vector<double> > r (k, Vector<double> (n)), r_hat (k, Vector<double> (n)),
+      p (k, Vector<double> (n)), p_hat (k, Vector<double> (n)), v (k, Vector<double> (n)),
+      s_hat (k, Vector<double> (n)), t (k, Vector<double> (n));
+  std::vector<double> rho (k, 1.), alpha (k, 1.), omega (k, 1.);
+  std::vector<SolverControl::State> state (k);
+
+  std::vector<Vector<double> *>       dst;
+  std::vector<const Vector<double> *> src;
+
+  for (unsigned int i=0; i<k; ++i)
+    {
+      dst.push_back (&r[i]);
+      src.push_back (x[i]);
+    }
+  vmult_batched (A, dst, src);
+
+  std::vector<unsigned int> active;
+  for (unsigned int i=0; i<k; ++i)
+    {
+      r[i].sadd (-1., 1., *b[i]);
+      r_hat[i] = r[i];
+      state[i] = solver_controls[i].check (0, r[i].l2_norm());
+      if (state[i] == SolverControl::iterate)
+        active.push_back (i);
+    }
+
+  for (unsigned int step=1; active.size() > 0; ++step)
+    {
+      // p = r + beta (p - omega v), p_hat = D^{-1} p, v = A p_hat
+      dst.clear ();
+      src.clear ();
+      for (unsigned int a=0; a<active.size(); ++a)
+        {
+          const unsigned int i = active[a];
+          double rho_new = r_hat[i] * r[i];
+          if (std::fabs (rho_new) < breakdown)
+            {
+              // Restart: r_hat = r, so that rho = |r|^2.
+              r_hat[i] = r[i];
+              p[i]     = 0;
+              v[i]     = 0;
+              rho[i] = alpha[i] = omega[i] = 1.;
+              rho_new = r_hat[i] * r[i];
+            }
+          const double beta    = (rho_new / rho[i]) * (alpha[i] / omega[i]);
+          rho[i] = rho_new;
+
+          p[i].add (-omega[i], v[i]);
+          p[i].sadd (beta, 1., r[i]);
+          p_hat[i] = p[i];
+          p_hat[i].scale (inverse_diagonal);
+
+          dst.push_back (&v[i]);
+          src.push_back (&p_hat[i]);
+        }
+      vmult_batched (A, dst, src);
+
+      // s = r - alpha v (stored in r), s_hat = D^{-1} s, t = A s_hat
+      std::vector<unsigned int> second_half, restarted;
+      dst.clear ();
+      src.clear ();
+      for (unsigned int a=0; a<active.size(); ++a)
+        {
+          const unsigned int i = active[a];
+          const double r_hat_v = r_hat[i] * v[i];
+          if (std::fabs (r_hat_v) < breakdown)
+            {
+              // Restart this system with its current residual.
+              r_hat[i] = r[i];
+              p[i]     = 0;
+              v[i]     = 0;
+              rho[i] = alpha[i] = omega[i] = 1.;
+              state[i] = solver_controls[i].check (step, r[i].l2_norm());
+              if (state[i] == SolverControl::iterate)
+                restarted.push_back (i);
+              continue;
+            }
+          alpha[i] = rho[i] / r_hat_v;
+          r[i].add (-alpha[i], v[i]);
+          x[i]->add (alpha[i], p_hat[i]);
+
+          state[i] = solver_controls[i].check (step, r[i].l2_norm());
+          if (state[i] != SolverControl::iterate)
+            continue;
+
+          s_hat[i] = r[i];
+          s_hat[i].scale (inverse_diagonal);
+          second_half.push_back (i);
+          dst.push_back (&t[i]);
+          src.push_back (&s_hat[i]);
+        }
+      if (second_half.size() > 0)
+        vmult_batched (A, dst, src);
+
+      // omega = (t,s)/(t,t), x += omega s_hat, r = s - omega t
+      active.swap (restarted);
+      for (unsigned int a=0; a<second_half.size(); ++a)
+        {
+          const unsigned int i = second_half[a];
+          const double t_t = t[i] * t[i];
+          if (t_t < breakdown)
+            {
+              // x and r stay at the half step; restart from there.
+              r_hat[i] = r[i];
+              p[i]     = 0;
+              v[i]     = 0;
+              rho[i] = alpha[i] = omega[i] = 1.;
+              active.push_back (i);
+              continue;
+            }
+          omega[i] = (t[i] * r[i]) / t_t;
+          x[i]->add (omega[i], s_hat[i]);
+          r[i].add (-omega[i], t[i]);
+
+          state[i] = solver_controls[i].check (step, r[i].l2_norm());
+          if (state[i] == SolverControl::iterate)
+            active.push_back (i);
+        }
+    }
+
+  for (unsigned int i=0; i<k; ++i)
+    AssertThrow (state[i] == SolverControl::success,
+                 SolverControl::NoConvergence (solver_controls[i].last_step(),
+                                               solver_controls[i].last_value()));
+}
+
+
+
+/*
+ * Ensemble of Burgers problems on one shared mesh.
+ *
+ * The members differ in viscosity, forcing period and time step only, so
+ * the triangulation, the DoF handler, the constraints and the sparsity
+ * pattern are built once. Each member owns its matrix and vectors. The
+ * assembly loops over the cells once per round and evaluates the shape
+ * functions once for all members that take a step in that round, and the
+ * linear solves of the members run as concurrent tasks. Members with a
+ * larger time step simply drop out of the rounds once they reach the final
+ * time. The mesh is fixed, since refinement would have to follow the
+ * indicator of a single member.
+ *
+ * Convection is treated implicitly by default, with the linearized
+ * implicit Euler operator of Burger::assemble_system_2(). With
+ * explicit_convection (IMEX Euler), every member's operator is the constant
+ * M + dt nu K instead. If, in addition, batched is set and all members have
+ * the same viscosity and time step, they share this operator: it is
+ * assembled once, and the members' systems are solved together with
+ * SolverBatchedBiCGStab, which streams the matrix once for all right hand
+ * sides. The discretization is the same with and without batching.
+ */
+template <int dim>
+class BurgerEnsemble
+{
+public:
+  enum ForcingType
+  {
+    cavity_forcing,
+    manufactured_forcing,
+    unforced
+  };
+
+  struct MemberParameters
+  {
+    MemberParameters (const double      nu             = 1.0,
+                      const double      forcing_period = 0.2,
+                      const double      time_step      = 1. / 500,
+                      const ForcingType forcing        = cavity_forcing)
+      :
+      nu (nu),
+      forcing_period (forcing_period),
+      time_step (time_step),
+      forcing (forcing)
+    {}
+
+    double      nu;
+    double      forcing_period;
+    double      time_step;
+    ForcingType forcing;
+  };
+
+  enum ConvectionTreatment
+  {
+    implicit_convection,
+    explicit_convection
+  };
+
+  BurgerEnsemble (const std::vector<MemberParameters> &parameters,
+                  const unsigned int                   n_global_refinements = 5,
+                  const ConvectionTreatment            convection           = implicit_convection,
+                  const bool                           batched              = false);
+  ~BurgerEnsemble ();
+
+  void run (const double final_time);
+
+private:
+  struct Member
+  {
+    MemberParameters     parameters;
+
+    SparseMatrix<double> system_matrix;
+    Vector<double>       old_solution;
+    Vector<double>       solution;
+    Vector<double>       system_rhs;
+
+    double               time;
+    unsigned int         timestep_number;
+    unsigned int         n_iterations;
+  };
+
+  void make_grid ();
+  void setup_system ();
+  std::shared_ptr<const Function<dim> > forcing (const Member &member) const;
+  void assemble_shared_operator ();
+  void assemble_systems (const std::vector<unsigned int> &stepping_members);
+  void solve_member (const unsigned int m);
+  void solve_batched (const std::vector<unsigned int> &stepping_members);
+
+  const unsigned int   n_global_refinements;
+
+  Triangulation<dim>   triangulation;
+  FESystem<dim>        fe;
+  DoFHandler<dim>      dof_handler;
+
+  ConstraintMatrix     constraints;
+  SparsityPattern      sparsity_pattern;
+
+  std::vector<Member>  members;
+
+  const ConvectionTreatment convection;
+  const bool                batched;
+  SparseMatrix<double> shared_matrix;
+  Vector<double>       shared_inverse_diagonal;
+};
+
+
+
+template <int dim>
+BurgerEnsemble<dim>::BurgerEnsemble (const std::vector<MemberParameters> &parameters,
+                                     const unsigned int                   n_global_refinements,
+                                     const ConvectionTreatment            convection,
+                                     const bool                           batched)
+  :
+  n_global_refinements (n_global_refinements),
+  fe (FE_Q<dim>(1), dim),
+  dof_handler (triangulation),
+  members (parameters.size()),
+  convection (convection),
+  batched (batched)
+{
+  AssertThrow (!batched || (convection == explicit_convection),
+               ExcMessage ("Only the explicit convection operator can be shared by a batch."));
+  for (unsigned int m=0; m<members.size(); ++m)
+    {
+      members[m].parameters = parameters[m];
+      AssertThrow (!batched ||
+                   ((parameters[m].nu == parameters[0].nu) &&
+                    (parameters[m].time_step == parameters[0].time_step)),
+                   ExcMessage ("The members of a batch have to share nu and the time step."));
+    }
+}
+
+
+
+template <int dim>
+BurgerEnsemble<dim>::~BurgerEnsemble ()
+{
+  // The matrices point to sparsity_pattern and have to go first.
+  members.clear ();
+  shared_matrix.clear ();
+  dof_handler.clear ();
+}
+
+
+
+template <int dim>
+void BurgerEnsemble<dim>::make_grid ()
+{
+  GridGenerator::hyper_cube (triangulation, -1, 1);
+  triangulation.refine_global (n_global_refinements);
+
+  std::cout << "   Number of active cells: "
+            << triangulation.n_active_cells()
+            << std::endl;
+}
+
+
+
+template <int dim>
+void BurgerEnsemble<dim>::setup_system ()
+{
+  dof_handler.distribute_dofs (fe);
+
+  std::cout << "   Number of degrees of freedom: "
+            << dof_handler.n_dofs()
+            << " per member, "
+            << members.size()
+            << " members"
+            << std::endl;
+
+  constraints.clear ();
+  DoFTools::make_hanging_node_constraints (dof_handler,
+                                           constraints);
+  VectorTools::interpolate_boundary_values (dof_handler,
+                                            0,
+                                            ZeroFunction<dim>(dim),
+                                            constraints);
+  constraints.close ();
+
+  DynamicSparsityPattern  c_sparsity(dof_handler.n_dofs());
+  DoFTools::make_sparsity_pattern(dof_handler, c_sparsity, constraints, /*keep_constrained_dofs = */ true);
+  sparsity_pattern.copy_from(c_sparsity);
+
+  if (batched)
+    shared_matrix.reinit (sparsity_pattern);
+
+  for (unsigned int m=0; m<members.size(); ++m)
+    {
+      if (!batched)
+        members[m].system_matrix.reinit (sparsity_pattern);
+      members[m].old_solution.reinit (dof_handler.n_dofs());
+      members[m].solution.reinit (dof_handler.n_dofs());
+      members[m].system_rhs.reinit (dof_handler.n_dofs());
+      members[m].time            = 0;
+      members[m].timestep_number = 0;
+      members[m].n_iterations    = 0;
+    }
+}
+
+
+
+template <int dim>
+std::shared_ptr<const Function<dim> >
+BurgerEnsemble<dim>::forcing (const Member &member) const
+{
+  switch (member.parameters.forcing)
+    {
+    case cavity_forcing:
+      return std::shared_ptr<const Function<dim> >
+             (new RightHandSide<dim> (member.time, member.parameters.forcing_period));
+    case manufactured_forcing:
+      return std::shared_ptr<const Function<dim> > (new BubbleGauss<dim> ());
+    case unforced:
+      return std::shared_ptr<const Function<dim> > (new RightHandSide1<dim> ());
+    default:
+      Assert (false, ExcNotImplemented());
+      return std::shared_ptr<const Function<dim> > ();
+    }
+}
+
+
+
+template <int dim>
+void BurgerEnsemble<dim>::assemble_shared_operator ()
+{
+  QGauss<dim>  quadrature_formula(2);
+
+  FEValues<dim> fe_values (fe, quadrature_formula,
+                           update_values   | update_gradients |
+                           update_JxW_values);
+
+  const unsigned int   dofs_per_cell = fe.dofs_per_cell;
+  const unsigned int   n_q_points    = quadrature_formula.size();
+  const double         dt            = members[0].parameters.time_step;
+  const double         nu            = members[0].parameters.nu;
+
+  FullMatrix<double>   cell_matrix (dofs_per_cell, dofs_per_cell);
+  std::vector<types::global_dof_index> local_dof_indices (dofs_per_cell);
+
+  shared_matrix = 0;
+
+  typename DoFHandler<dim>::active_cell_iterator
+  cell = dof_handler.begin_active(),
+  endc = dof_handler.end();
+  for (; cell!=endc; ++cell)
+    {
+      fe_values.reinit (cell);
+      const FEValuesViews::Vector<dim>& fe_vector_values = fe_values[FEValuesExtractors::Vector(0)];
+
+      cell_matrix = 0;
+      for (unsigned int q_index=0; q_index<n_q_points; ++q_index)
+        for (unsigned int i=0; i<dofs_per_cell; ++i)
+          for (unsigned int j=0; j<dofs_per_cell; ++j)
+            cell_matrix(i,j) += ( fe_vector_values.value (i, q_index) * fe_vector_values.value (j, q_index)
+                                  +
+                                  nu*dt*double_contract(fe_vector_values.gradient (i, q_index),
+                                                        fe_vector_values.gradient (j, q_index))
+                                )*fe_values.JxW (q_index);
+
+      cell->get_dof_indices (local_dof_indices);
+      constraints.distribute_local_to_global (cell_matrix, local_dof_indices,
+                                              shared_matrix);
+    }
+
+  shared_inverse_diagonal.reinit (dof_handler.n_dofs());
+  for (unsigned int i=0; i<dof_handler.n_dofs(); ++i)
+    shared_inverse_diagonal(i) = 1. / shared_matrix.diag_element (i);
+}
+
+
+
+template <int dim>
+void BurgerEnsemble<dim>::assemble_systems (const std::vector<unsigned int> &stepping_members)
+{
+  // Same linearized implicit Euler operator as Burger::assemble_system_2(),
+  // with the member's nu and time step, or M + dt nu K and the right hand
+  // side with explicit convection. If the operator is shared by a batch,
+  // only the right hand side is assembled. Shape function values and
+  // gradients are fetched once per quadrature point and shared by all
+  // members.
+  QGauss<dim>  quadrature_formula(2);
+
+  FEValues<dim> fe_values (fe, quadrature_formula,
+                           update_values   | update_gradients |
+                           update_quadrature_points | update_JxW_values);
+
+  const unsigned int   dofs_per_cell = fe.dofs_per_cell;
+  const unsigned int   n_q_points    = quadrature_formula.size();
+  const unsigned int   n_stepping    = stepping_members.size();
+
+  std::vector<FullMatrix<double> > cell_matrix (n_stepping, FullMatrix<double> (dofs_per_cell, dofs_per_cell));
+  std::vector<Vector<double> >     cell_rhs (n_stepping, Vector<double> (dofs_per_cell));
+
+  std::vector<types::global_dof_index>        local_dof_indices (dofs_per_cell);
+  std::vector<std::vector<Tensor<1, dim> > >  old_values (n_stepping, std::vector<Tensor<1, dim> > (n_q_points));
+  std::vector<std::vector<double> >           old_div (n_stepping, std::vector<double> (n_q_points));
+  std::vector<std::vector<Tensor<2, dim> > >  old_grad (n_stepping, std::vector<Tensor<2, dim> > (n_q_points));
+
+  std::vector<Tensor<1, dim> >  shape_values (dofs_per_cell);
+  std::vector<Tensor<2, dim> >  shape_grads (dofs_per_cell);
+
+  std::vector<std::shared_ptr<const Function<dim> > > right_hand_sides;
+  for (unsigned int s=0; s<n_stepping; ++s)
+    {
+      Member &member = members[stepping_members[s]];
+      right_hand_sides.push_back (forcing (member));
+      if (!batched)
+        member.system_matrix = 0;
+      member.system_rhs    = 0;
+    }
+
+  typename DoFHandler<dim>::active_cell_iterator
+  cell = dof_handler.begin_active(),
+  endc = dof_handler.end();
+  for (; cell!=endc; ++cell)
+    {
+      fe_values.reinit (cell);
+      const FEValuesViews::Vector<dim>& fe_vector_values = fe_values[FEValuesExtractors::Vector(0)];
+
+      for (unsigned int s=0; s<n_stepping; ++s)
+        {
+          const Member &member = members[stepping_members[s]];
+          fe_vector_values.get_function_values (member.old_solution, old_values[s]);
+          fe_vector_values.get_function_divergences (member.old_solution, old_div[s]);
+          if (convection == explicit_convection)
+            fe_vector_values.get_function_gradients (member.old_solution, old_grad[s]);
+          cell_matrix[s] = 0;
+          cell_rhs[s]    = 0;
+        }
+
+      for (unsigned int q_index=0; q_index<n_q_points; ++q_index)
+        {
+          for (unsigned int i=0; i<dofs_per_cell; ++i)
+            {
+              shape_values[i] = fe_vector_values.value (i, q_index);
+              shape_grads[i]  = fe_vector_values.gradient (i, q_index);
+            }
+          const double JxW = fe_values.JxW (q_index);
+
+          for (unsigned int s=0; s<n_stepping; ++s)
+            {
+              const Member &member    = members[stepping_members[s]];
+              const double  dt        = member.parameters.time_step;
+              const double  nu        = member.parameters.nu;
+              const Tensor<1, dim> &u_star     = old_values[s][q_index];
+              const double          u_star_div = old_div[s][q_index];
+
+              Tensor<1, dim> rhs_val;
+              for (unsigned int d=0; d<dim; ++d)
+                rhs_val[d] = right_hand_sides[s]->value (fe_values.quadrature_point (q_index), d);
+
+              if (convection == explicit_convection)
+                {
+                  // Explicit convection; the operator is M + dt nu K, the
+                  // same as in assemble_shared_operator().
+                  Tensor<1, dim> convection_term = 0.5*u_star_div*u_star;
+                  for (unsigned int c=0; c<dim; ++c)
+                    for (unsigned int d=0; d<dim; ++d)
+                      convection_term[c] += old_grad[s][q_index][c][d] * u_star[d];
+                  for (unsigned int i=0; i<dofs_per_cell; ++i)
+                    {
+                      if (!batched)
+                        for (unsigned int j=0; j<dofs_per_cell; ++j)
+                          cell_matrix[s](i,j) += ( shape_values[i] * shape_values[j]
+                                                   +
+                                                   nu*dt*double_contract(shape_grads[i], shape_grads[j])
+                                                 ) * JxW;
+
+                      cell_rhs[s](i) += ( u_star * shape_values[i]
+                                          + dt * ((rhs_val - convection_term) * shape_values[i])
+                                        ) * JxW;
+                    }
+                  continue;
+                }
+
+              for (unsigned int i=0; i<dofs_per_cell; ++i)
+                {
+                  for (unsigned int j=0; j<dofs_per_cell; ++j)
+                    cell_matrix[s](i,j) += ConvectionDiffusion::VectorBurgers<dim>::operator_entry
+                                           (nu, dt, u_star, u_star_div,
+                                            shape_values[i], shape_grads[i],
+                                            shape_values[j], shape_grads[j])
+                                           * JxW;
+
+                  cell_rhs[s](i) += (u_star * shape_values[i] + dt * (rhs_val * shape_values[i])) * JxW;
+                }
+            }
+        }
+
+      cell->get_dof_indices (local_dof_indices);
+      for (unsigned int s=0; s<n_stepping; ++s)
+        {
+          Member &member = members[stepping_members[s]];
+          if (batched)
+            constraints.distribute_local_to_global (cell_rhs[s],
+                                                    local_dof_indices,
+                                                    member.system_rhs);
+          else
+            constraints.distribute_local_to_global (cell_matrix[s], cell_rhs[s],
+                                                    local_dof_indices,
+                                                    member.system_matrix,
+                                                    member.system_rhs);
+        }
+    }
+}
+
+
+
+template <int dim>
+void BurgerEnsemble<dim>::solve_member (const unsigned int m)
+{
+  // Runs as its own task; everything it touches belongs to member m, and
+  // SolverFusedGMRES keeps its Krylov basis in the solver object.
+  Member &member = members[m];
+
+  PreconditionSSOR<> preconditioner;
+  preconditioner.initialize (member.system_matrix, 1.0);
+
+  member.solution = member.old_solution;
+
+  SolverControl solver_control (5000, 1e-9*member.system_rhs.l2_norm());
+  SolverFusedGMRES gmres (solver_control,
+                          SolverFusedGMRES::AdditionalData (30));
+  gmres.solve (member.system_matrix, member.solution, member.system_rhs,
+               preconditioner);
+
+  constraints.distribute (member.solution);
+  member.n_iterations = solver_control.last_step();
+}
+
+
+
+template <int dim>
+void BurgerEnsemble<dim>::solve_batched (const std::vector<unsigned int> &stepping_members)
+{
+  std::vector<SolverControl>          solver_controls;
+  std::vector<Vector<double> *>       x;
+  std::vector<const Vector<double> *> b;
+  for (unsigned int s=0; s<stepping_members.size(); ++s)
+    {
+      Member &member = members[stepping_members[s]];
+      member.solution = member.old_solution;
+      solver_controls.push_back (SolverControl (5000, 1e-9*member.system_rhs.l2_norm()));
+      x.push_back (&member.solution);
+      b.push_back (&member.system_rhs);
+    }
+
+  SolverBatchedBiCGStab bicgstab (solver_controls);
+  bicgstab.solve (shared_matrix, x, b, shared_inverse_diagonal);
+
+  for (unsigned int s=0; s<stepping_members.size(); ++s)
+    {
+      Member &member = members[stepping_members[s]];
+      constraints.distribute (member.solution);
+      member.n_iterations = solver_controls[s].last_step();
+    }
+}
+
+
+
+template <int dim>
+void BurgerEnsemble<dim>::run (const double final_time)
+{
+  std::cout << "Ensemble of " << members.size() << " Burgers problems in "
+            << dim << " space dimensions." << std::endl;
+
+  make_grid ();
+  setup_system ();
+
+  Timer timer;
+  timer.start ();
+
+  if (batched)
+    assemble_shared_operator ();
+
+  unsigned int n_member_steps = 0;
+  unsigned int round          = 0;
+  while (true)
+    {
+      std::vector<unsigned int> stepping_members;
+      for (unsigned int m=0; m<members.size(); ++m)
+        if (members[m].time < final_time)
+          stepping_members.push_back (m);
+      if (stepping_members.size() == 0)
+        break;
+
+      assemble_systems (stepping_members);
+
+      if (batched)
+        solve_batched (stepping_members);
+      else
+        {
+          Threads::TaskGroup<> tasks;
+          for (unsigned int s=0; s<stepping_members.size(); ++s)
+            tasks += Threads::new_task (&BurgerEnsemble<dim>::solve_member,
+                                        *this, stepping_members[s]);
+          tasks.join_all ();
+        }
+
+      std::cout << "Round " << round << ":";
+      for (unsigned int s=0; s<stepping_members.size(); ++s)
+        {
+          Member &member = members[stepping_members[s]];
+          member.old_solution = member.solution;
+          member.time += member.parameters.time_step;
+          ++member.timestep_number;
+          std::cout << " " << member.n_iterations;
+        }
+      std::cout << (batched ? " BiCGStab" : " GMRES") << " iterations" << std::endl;
+
+      n_member_steps += stepping_members.size();
+      ++round;
+    }
+
+  timer.stop ();
+
+  std::cout << "   " << n_member_steps << " member steps in "
+            << timer.wall_time() << " s: "
+            << n_member_steps / timer.wall_time()
+            << " member-steps per second." << std::endl;
+}
+
+
+
+/*
+ * Discontinuous Galerkin variant of the cavity problem, for the
+ * convection-dominated regime of small viscosities.
+ *
+ * The velocity is discretized with FE_DGQ elements. Convection is treated
+ * in the advective form (u.grad)u with a local Lax-Friedrichs flux: on a
+ * face with normal n, the cell on either side gets the penalty
+ * 1/2 (lambda - {u}.n) (u_inside - u_outside), where
+ * lambda = max(|u^-.n|, |u^+.n|), which reduces to the upwind flux for
+ * lambda = |{u}.n|. Viscosity uses the symmetric interior penalty method.
+ * The no-slip condition is imposed weakly with a zero exterior state.
+ *
+ * Since the mass matrix is block diagonal, the scheme is advanced with the
+ * explicit SSP-RK3 method, applying the inverse of each cell's mass matrix
+ * after every right hand side evaluation. The right hand side is assembled
+ * in one loop over cells, in which integrate_cell(), integrate_boundary()
+ * and integrate_face() play the role of MeshWorker's cell, boundary and
+ * face workers; every interior face is visited once, from the cell with
+ * the smaller index. The mesh is uniform, so there are no hanging faces.
+ */
+template <int dim>
+class BurgerDG
+{
+public:
+  BurgerDG (const unsigned int degree               = 1,
+            const unsigned int n_global_refinements = 5,
+            const double       nu                   = 1e-3);
+
+  void run (const double final_time);
+
+private:
+  struct ScratchData
+  {
+    ScratchData (const FiniteElement<dim> &fe,
+                 const Quadrature<dim>     &quadrature,
+                 const Quadrature<dim-1>   &face_quadrature);
+
+    FEValues<dim>                 fe_values;
+    FEFaceValues<dim>             fe_face_values;
+    FEFaceValues<dim>             fe_face_values_neighbor;
+    Vector<double>                local_values;
+    Vector<double>                local_values_neighbor;
+    std::vector<Tensor<1, dim> >  values;
+    std::vector<Tensor<1, dim> >  values_neighbor;
+    std::vector<Tensor<2, dim> >  gradients;
+    std::vector<Tensor<2, dim> >  gradients_neighbor;
+
+    Vector<double>                cell_rhs;
+    Vector<double>                neighbor_rhs;
+    Vector<double>                local_du;
+    std::vector<types::global_dof_index> local_dof_indices;
+    std::vector<types::global_dof_index> neighbor_dof_indices;
+  };
+
+  void make_grid_and_dofs ();
+  void assemble_inverse_mass_matrices ();
+  void evaluate (const FEValuesBase<dim>      &fe_values,
+                 const Vector<double>         &local_values,
+                 std::vector<Tensor<1, dim> > &values,
+                 std::vector<Tensor<2, dim> > &gradients) const;
+  void integrate_cell (const typename DoFHandler<dim>::active_cell_iterator &cell,
+                       const Vector<double>                                 &u,
+                       const double                                          stage_time,
+                       ScratchData                                          &scratch,
+                       Vector<double>                                       &cell_rhs) const;
+  void integrate_boundary (const typename DoFHandler<dim>::active_cell_iterator &cell,
+                           const unsigned int                                    face_no,
+                           const Vector<double>                                 &u,
+                           ScratchData                                          &scratch,
+                           Vector<double>                                       &cell_rhs) const;
+  void integrate_face (const typename DoFHandler<dim>::active_cell_iterator &cell,
+                       const unsigned int                                    face_no,
+                       const typename DoFHandler<dim>::active_cell_iterator &neighbor,
+                       const unsigned int                                    neighbor_face_no,
+                       const Vector<double>                                 &u,
+                       ScratchData                                          &scratch,
+                       Vector<double>                                       &cell_rhs,
+                       Vector<double>                                       &neighbor_rhs) const;
+  void compute_rhs (const Vector<double> &u,
+                    const double          stage_time,
+                    Vector<double>       &du);
+  double compute_time_step () const;
+  void output_results (const unsigned int output_number) const;
+
+  Triangulation<dim>               triangulation;
+  FESystem<dim>                    fe;
+  DoFHandler<dim>                  dof_handler;
+  ScratchData                      scratch;
+
+  std::vector<FullMatrix<double> > inverse_mass_matrices;
+  Vector<double>                   solution;
+
+  const unsigned int               n_global_refinements;
+  const double                     nu;
+  double                           cfl_number;
+  double                           penalty_factor;
+};
+
+
+
+template <int dim>
+BurgerDG<dim>::ScratchData::ScratchData (const FiniteElement<dim> &fe,
+                                         const Quadrature<dim>     &quadrature,
+                                         const Quadrature<dim-1>   &face_quadrature)
+  :
+  fe_values (fe, quadrature,
+             update_values | update_gradients |
+             update_quadrature_points | update_JxW_values),
+  fe_face_values (fe, face_quadrature,
+                  update_values | update_gradients |
+                  update_normal_vectors | update_JxW_values),
+  fe_face_values_neighbor (fe, face_quadrature,
+                           update_values | update_gradients),
+  local_values (fe.dofs_per_cell),
+  local_values_neighbor (fe.dofs_per_cell),
+  values (std::max (quadrature.size(), face_quadrature.size())),
+  values_neighbor (face_quadrature.size()),
+  gradients (std::max (quadrature.size(), face_quadrature.size())),
+  gradients_neighbor (face_quadrature.size()),
+  cell_rhs (fe.dofs_per_cell),
+  neighbor_rhs (fe.dofs_per_cell),
+  local_du (fe.dofs_per_cell),
+  local_dof_indices (fe.dofs_per_cell),
+  neighbor_dof_indices (fe.dofs_per_cell)
+{}
+
+
+
+template <int dim>
+BurgerDG<dim>::BurgerDG (const unsigned int degree,
+                         const unsigned int n_global_refinements,
+                         const double       nu)
+  :
+  fe (FE_DGQ<dim>(degree), dim),
+  dof_handler (triangulation),
+  scratch (fe, QGauss<dim>(degree+1), QGauss<dim-1>(degree+1)),
+  n_global_refinements (n_global_refinements),
+  nu (nu),
+  cfl_number (0.3),
+  penalty_factor (2.0)
+{}
+
+
+
+template <int dim>
+void BurgerDG<dim>::make_grid_and_dofs ()
+{
+  GridGenerator::hyper_cube (triangulation, -1, 1);
+  triangulation.refine_global (n_global_refinements);
+
+  dof_handler.distribute_dofs (fe);
+  solution.reinit (dof_handler.n_dofs());
+
+  std::cout << "   Number of active cells: "
+            << triangulation.n_active_cells()
+            << std::endl
+            << "   Number of degrees of freedom: "
+            << dof_handler.n_dofs()
+            << std::endl;
+}
+
+
+
+template <int dim>
+void BurgerDG<dim>::assemble_inverse_mass_matrices ()
+{
+  QGauss<dim>   quadrature_formula (fe.degree+1);
+  FEValues<dim> fe_values (fe, quadrature_formula,
+                           update_values | update_JxW_values);
+
+  const unsigned int dofs_per_cell = fe.dofs_per_cell;
+  FullMatrix<double> cell_mass (dofs_per_cell, dofs_per_cell);
+
+  inverse_mass_matrices.resize (triangulation.n_active_cells(),
+                                FullMatrix<double> (dofs_per_cell, dofs_per_cell));
+
+  unsigned int index = 0;
+  typename DoFHandler<dim>::active_cell_iterator
+  cell = dof_handler.begin_active(),
+  endc = dof_handler.end();
+  for (; cell!=endc; ++cell, ++index)
+    {
+      fe_values.reinit (cell);
+      cell_mass = 0;
+      for (unsigned int q=0; q<quadrature_formula.size(); ++q)
+        for (unsigned int i=0; i<dofs_per_cell; ++i)
+          for (unsigned int j=0; j<dofs_per_cell; ++j)
+            if (fe.system_to_component_index (i).first == fe.system_to_component_index (j).first)
+              cell_mass(i,j) += fe_values.shape_value (i, q) *
+                                fe_values.shape_value (j, q) *
+                                fe_values.JxW (q);
 
+      inverse_mass_matrices[index].invert (cell_mass);
+    }
 }
 
-template<int dim>
-double BubbleGauss<dim>::value(const Point<dim>& p, const unsigned component ) const {
-
-	const double& r2 = (p - center).norm_square();
 
-    switch (component) {
-      case 0:  return  2*(p[0]*p[0] - 1)*(p[1]*p[1] - 1)*(p[0]*(p[1]*p[1] - 1) + p[1]*(p[0]*p[0] - 1))
-    		            -1.0*(2.0*(p[1]*p[1] - 1) + 2*(p[0]*p[0] - 1)) ;
-                                   break;//amplitude * std::exp(-sigma * r2); break;
 
-      case 1:  return  2*(p[0]*p[0] - 1)*(p[1]*p[1] - 1)*(p[0]*(p[1]*p[1] - 1) + p[1]*(p[0]*p[0] - 1))
-	                    -1.0*(2.0*(p[1]*p[1] - 1) + 2*(p[0]*p[0] - 1)) ;
-                                   break;//0.1; break;
-      default: return 0;
+template <int dim>
+void BurgerDG<dim>::evaluate (const FEValuesBase<dim>      &fe_values,
+                              const Vector<double>         &local_values,
+                              std::vector<Tensor<1, dim> > &values,
+                              std::vector<Tensor<2, dim> > &gradients) const
+{
+  for (unsigned int q=0; q<fe_values.n_quadrature_points; ++q)
+    {
+      values[q]    = 0;
+      gradients[q] = 0;
+      for (unsigned int i=0; i<fe.dofs_per_cell; ++i)
+        {
+          const unsigned int component = fe.system_to_component_index (i).first;
+          values[q][component]    += local_values(i) * fe_values.shape_value (i, q);
+          gradients[q][component] += local_values(i) * fe_values.shape_grad (i, q);
+        }
     }
-
 }
 
+
+
 template <int dim>
-void
-BubbleGauss<dim>::vector_value (const Point<dim>  &points,
-		 	 	 	 	 	 	 Vector<double> &values) const
+void BurgerDG<dim>::integrate_cell (const typename DoFHandler<dim>::active_cell_iterator &cell,
+                                    const Vector<double>                                 &u,
+                                    const double                                          stage_time,
+                                    ScratchData                                          &scratch,
+                                    Vector<double>                                       &cell_rhs) const
 {
+  const RightHandSide<dim> right_hand_side (stage_time);
+  FEValues<dim>           &fe_values = scratch.fe_values;
 
-	for (unsigned int c=0; c<this->n_components; ++c)
-	  values(c) = BubbleGauss<dim>::value (points, c);
+  fe_values.reinit (cell);
+  cell->get_dof_values (u, scratch.local_values);
+  evaluate (fe_values, scratch.local_values, scratch.values, scratch.gradients);
 
+  for (unsigned int q=0; q<fe_values.n_quadrature_points; ++q)
+    {
+      const Tensor<1, dim> &u_q    = scratch.values[q];
+      const Tensor<2, dim> &grad_u = scratch.gradients[q];
+
+      Tensor<1, dim> convection, forcing;
+      for (unsigned int c=0; c<dim; ++c)
+        {
+          for (unsigned int d=0; d<dim; ++d)
+            convection[c] += grad_u[c][d] * u_q[d];
+          forcing[c] = right_hand_side.value (fe_values.quadrature_point (q), c);
+        }
+
+      for (unsigned int i=0; i<fe.dofs_per_cell; ++i)
+        {
+          const unsigned int c = fe.system_to_component_index (i).first;
+          cell_rhs(i) += ( (forcing[c] - convection[c]) * fe_values.shape_value (i, q)
+                           - nu * (grad_u[c] * fe_values.shape_grad (i, q))
+                         ) * fe_values.JxW (q);
+        }
+    }
 }
 
-template <int dim>
-class ExactSolution : public dealii::Function<dim> {
-public:
-  ExactSolution(): Function<dim>(dim){} ;
-  virtual void vector_value (const Point<dim>  &points,
-		  Vector<double> &value) const;
-
-};
 
 
 template <int dim>
-void
-ExactSolution<dim>::vector_value (const Point<dim>  &p,
-		 	 	 	 	 	 	 Vector<double> &values) const
+void BurgerDG<dim>::integrate_boundary (const typename DoFHandler<dim>::active_cell_iterator &cell,
+                                        const unsigned int                                    face_no,
+                                        const Vector<double>                                 &u,
+                                        ScratchData                                          &scratch,
+                                        Vector<double>                                       &cell_rhs) const
 {
-    Assert (values.size() == dim,
-            ExcDimensionMismatch (values.size(), dim));
+  FEFaceValues<dim> &fe_face_values = scratch.fe_face_values;
 
-    values(0) = (p[0]*p[0] - 1)*(p[1]*p[1] - 1) ;
-    values(1) = (p[0]*p[0] - 1)*(p[1]*p[1] - 1) ;
+  fe_face_values.reinit (cell, face_no);
+  cell->get_dof_values (u, scratch.local_values);
+  evaluate (fe_face_values, scratch.local_values, scratch.values, scratch.gradients);
 
+  const double h     = cell->measure () / cell->face (face_no)->measure ();
+  const double sigma = penalty_factor * (fe.degree + 1) * (fe.degree + 1) / h;
+
+  // Exterior state zero: {u} = u/2 and [u] = u.
+  for (unsigned int q=0; q<fe_face_values.n_quadrature_points; ++q)
+    {
+      const Tensor<1, dim> &normal  = fe_face_values.normal_vector (q);
+      const Tensor<1, dim> &u_q     = scratch.values[q];
+      const double          u_n     = u_q * normal;
+      const double          lambda  = std::fabs (u_n);
+      const double          upwind  = 0.5 * (lambda - 0.5 * u_n);
+
+      for (unsigned int i=0; i<fe.dofs_per_cell; ++i)
+        {
+          const unsigned int c   = fe.system_to_component_index (i).first;
+          const double       phi = fe_face_values.shape_value (i, q);
+          cell_rhs(i) += ( - upwind * u_q[c] * phi
+                           + nu * (scratch.gradients[q][c] * normal) * phi
+                           + nu * (fe_face_values.shape_grad (i, q) * normal) * u_q[c]
+                           - nu * sigma * u_q[c] * phi
+                         ) * fe_face_values.JxW (q);
+        }
+    }
 }
-/////////////////////////////////
+
+
+
 template <int dim>
-class BoundaryValues : public Function<dim>
+void BurgerDG<dim>::integrate_face (const typename DoFHandler<dim>::active_cell_iterator &cell,
+                                    const unsigned int                                    face_no,
+                                    const typename DoFHandler<dim>::active_cell_iterator &neighbor,
+                                    const unsigned int                                    neighbor_face_no,
+                                    const Vector<double>                                 &u,
+                                    ScratchData                                          &scratch,
+                                    Vector<double>                                       &cell_rhs,
+                                    Vector<double>                                       &neighbor_rhs) const
 {
-public:
-  virtual double value (const Point<dim>   &p,
-                        const unsigned int  component = 0) const;
-};
+  FEFaceValues<dim> &fe_face_values          = scratch.fe_face_values;
+  FEFaceValues<dim> &fe_face_values_neighbor = scratch.fe_face_values_neighbor;
+
+  fe_face_values.reinit (cell, face_no);
+  fe_face_values_neighbor.reinit (neighbor, neighbor_face_no);
+  cell->get_dof_values (u, scratch.local_values);
+  neighbor->get_dof_values (u, scratch.local_values_neighbor);
+  evaluate (fe_face_values, scratch.local_values, scratch.values, scratch.gradients);
+  evaluate (fe_face_values_neighbor, scratch.local_values_neighbor,
+            scratch.values_neighbor, scratch.gradients_neighbor);
+
+  const double h     = std::min (cell->measure (), neighbor->measure ())
+                       / cell->face (face_no)->measure ();
+  const double sigma = penalty_factor * (fe.degree + 1) * (fe.degree + 1) / h;
+
+  // The normal points from cell to neighbor; [u] = u - u_neighbor.
+  for (unsigned int q=0; q<fe_face_values.n_quadrature_points; ++q)
+    {
+      const Tensor<1, dim> &normal = fe_face_values.normal_vector (q);
+      const Tensor<1, dim> &u_q    = scratch.values[q];
+      const Tensor<1, dim> &u_nb   = scratch.values_neighbor[q];
+      const double          beta_n = 0.5 * ((u_q + u_nb) * normal);
+      const double          lambda = std::max (std::fabs (u_q * normal), std::fabs (u_nb * normal));
+      const double          JxW    = fe_face_values.JxW (q);
+
+      Tensor<1, dim> jump, average_gradient_n;
+      for (unsigned int c=0; c<dim; ++c)
+        {
+          jump[c]               = u_q[c] - u_nb[c];
+          average_gradient_n[c] = 0.5 * ((scratch.gradients[q][c] + scratch.gradients_neighbor[q][c]) * normal);
+        }
+
+      for (unsigned int i=0; i<fe.dofs_per_cell; ++i)
+        {
+          const unsigned int c   = fe.system_to_component_index (i).first;
+          const double       phi = fe_face_values.shape_value (i, q);
+          cell_rhs(i) += ( - 0.5 * (lambda - beta_n) * jump[c] * phi
+                           + nu * average_gradient_n[c] * phi
+                           + 0.5 * nu * (fe_face_values.shape_grad (i, q) * normal) * jump[c]
+                           - nu * sigma * jump[c] * phi
+                         ) * JxW;
+        }
+
+      for (unsigned int i=0; i<fe.dofs_per_cell; ++i)
+        {
+          const unsigned int c   = fe.system_to_component_index (i).first;
+          const double       phi = fe_face_values_neighbor.shape_value (i, q);
+          neighbor_rhs(i) += ( 0.5 * (lambda + beta_n) * jump[c] * phi
+                               - nu * average_gradient_n[c] * phi
+                               + 0.5 * nu * (fe_face_values_neighbor.shape_grad (i, q) * normal) * jump[c]
+                               + nu * sigma * jump[c] * phi
+                             ) * JxW;
+        }
+    }
+}
 
 
 
+template <int dim>
+void BurgerDG<dim>::compute_rhs (const Vector<double> &u,
+                                 const double          stage_time,
+                                 Vector<double>       &du)
+{
+  const unsigned int dofs_per_cell = fe.dofs_per_cell;
 
+  Vector<double> &cell_rhs     = scratch.cell_rhs;
+  Vector<double> &neighbor_rhs = scratch.neighbor_rhs;
+  Vector<double> &local_du     = scratch.local_du;
+  std::vector<types::global_dof_index> &local_dof_indices    = scratch.local_dof_indices;
+  std::vector<types::global_dof_index> &neighbor_dof_indices = scratch.neighbor_dof_indices;
 
+  du = 0;
 
+  typename DoFHandler<dim>::active_cell_iterator
+  cell = dof_handler.begin_active(),
+  endc = dof_handler.end();
+  for (; cell!=endc; ++cell)
+    {
+      cell->get_dof_indices (local_dof_indices);
+      cell_rhs = 0;
+      integrate_cell (cell, u, stage_time, scratch, cell_rhs);
 
-template<int dim>
-double BoundaryValues<dim>::value (const Point<dim> &/*p*/,
-                                   const unsigned int component) const
-{
-    Assert(component == 0, ExcInternalError());
-    return 0;
-}
+      for (unsigned int face_no=0; face_no<GeometryInfo<dim>::faces_per_cell; ++face_no)
+        if (cell->at_boundary (face_no))
+          integrate_boundary (cell, face_no, u, scratch, cell_rhs);
+        else if (cell->neighbor_index (face_no) > cell->index())
+          {
+            const typename DoFHandler<dim>::active_cell_iterator neighbor = cell->neighbor (face_no);
+            neighbor_rhs = 0;
+            integrate_face (cell, face_no, neighbor, cell->neighbor_of_neighbor (face_no),
+                            u, scratch, cell_rhs, neighbor_rhs);
+
+            neighbor->get_dof_indices (neighbor_dof_indices);
+            for (unsigned int i=0; i<dofs_per_cell; ++i)
+              du(neighbor_dof_indices[i]) += neighbor_rhs(i);
+          }
 
-template<int dim>
-double Burger<dim>::solution_bdf1(
-  const double& sol_old,
-  const double& sol_old_old
-) const{
-  return(
-	+ (2.0)*sol_old - (0.5)*sol_old_old
-	);
-}
+      for (unsigned int i=0; i<dofs_per_cell; ++i)
+        du(local_dof_indices[i]) += cell_rhs(i);
+    }
 
-template<int dim>
-double Burger<dim>::solution_bdf(
-  const double& sol_val,
-  const double& rhs_val,
-  const double& v_val,
-  const Tensor<1, dim>& sol_grad,
-  const Tensor<1, dim>& v_grad,
-  const Tensor<1, dim>& beta
-) const{
-  return(
-	+ sol_val*v_val
-	- time_step*contract(beta , sol_grad )* v_val
-//    + time_step * nu * sol_grad * v_grad
-    + time_step * rhs_val*v_val
-  );
+  // Block diagonal mass matrix: every DoF belongs to exactly one cell.
+  unsigned int index = 0;
+  for (cell = dof_handler.begin_active(); cell!=endc; ++cell, ++index)
+    {
+      cell->get_dof_values (du, cell_rhs);
+      inverse_mass_matrices[index].vmult (local_du, cell_rhs);
+      cell->set_dof_values (local_du, du);
+    }
 }
 
-template<int dim>
-double Burger<dim>::advection_cell_operator(
-  const double& u_val,
-  const double& v_val,
-  const Tensor<1, dim>& u_grad,
-  const Tensor<1, dim>& v_grad,
-  const Tensor<1, dim>& beta
-) const {
-  return (
-    + (1 - theta_skew) * contract(beta, u_grad) * v_val
-    + (0 - theta_skew) * contract(beta, v_grad) * u_val
-    );
-}
 
 
-template<int dim>
-double Burger<dim>::advection_face_operator(
-  const double& u_val,
-  const double& v_val,
-  const Tensor<1, dim>& beta,
-  const Tensor<1, dim>& normal
-) const {
-  return (
-    + theta_skew * contract(beta, normal) * v_val * u_val
-    );
-}
+template <int dim>
+double BurgerDG<dim>::compute_time_step () const
+{
+  // Convective limit h / ((2p+1) |u|_max) and diffusive limit
+  // h^2 / ((p+1)^2 sigma nu), with the nodal values as estimate of |u|_max.
+  const double h     = GridTools::minimal_cell_diameter (triangulation) / std::sqrt (1.*dim);
+  const double p     = fe.degree;
+  const double u_max = std::max (solution.linfty_norm () * std::sqrt (1.*dim), 1e-2);
 
-template<int dim>
-double Burger<dim>::lhs_operator(
-  const double& u_val,
-  const double& v_val,
-  const Tensor<1, dim>& u_grad,
-  const Tensor<1, dim>& v_grad,
-  const double& alpha,
-  const Tensor<1, dim>& beta
-) const {
-  return (
-    + theta_imex * advection_cell_operator(u_val, v_val, u_grad, v_grad, beta)
-    + theta_skew * alpha * (u_grad * v_grad)
-    + alpha * (u_grad * v_grad)
-    );
-}
+  const double convective_step = h / ((2*p + 1) * u_max);
+  const double diffusive_step  = h * h / ((p + 1) * (p + 1) * penalty_factor * (p + 1) * (p + 1) * nu);
 
-template<int dim>
-double Burger<dim>::streamline_diffusion(
-  const Tensor<1, dim>& u_grad,
-  const Tensor<1, dim>& v_grad,
-  const Tensor<1, dim>& beta
-) const {
-  const double dt = time_step;
-  return dt*dt/6*contract(beta, u_grad) * contract(beta, v_grad);
+  return cfl_number * std::min (convective_step, diffusive_step);
 }
 
-template <int dim>
-Burger<dim>::Burger ()
-  :
-  fe (FE_Q<dim>(1), dim),
-  dof_handler (triangulation),
-  timestep_number(0),
-  time_step(1. / 500),
-  time(0),
-  theta_imex(0.5),
-  theta_skew(0.5)
-{}
 
-template <int dim>
-Burger<dim>::~Burger (){
-  dof_handler.clear ();
-}
 
 template <int dim>
-void Burger<dim>::make_grid ()
+void BurgerDG<dim>::output_results (const unsigned int output_number) const
 {
-//  GridGenerator::hyper_L(triangulation);
-  GridGenerator::hyper_cube (triangulation, -1, 1);
-  triangulation.refine_global (3);
-
-  std::cout << "   Number of active cells: "
-            << triangulation.n_active_cells()
-            << std::endl
-            << "   Total number of cells: "
-            << triangulation.n_cells()
-            << std::endl;
+  std::vector<std::string> solution_names (dim, "velocity");
+
+  std::vector<DataComponentInterpretation::DataComponentInterpretation>
+  data_component_interpretation
+  (dim, DataComponentInterpretation::component_is_part_of_vector);
+
+  DataOut<dim> data_out;
+  data_out.attach_dof_handler (dof_handler);
+  data_out.add_data_vector (solution, solution_names,
+                            DataOut<dim>::type_dof_data,
+                            data_component_interpretation);
+  data_out.build_patches (fe.degree);
+
+  std::ostringstream filename;
+  filename << "solution-dg-"
+           << Utilities::int_to_string (output_number, 3)
+           << ".vtk";
+  std::ofstream output (filename.str().c_str());
+  data_out.write_vtk (output);
 }
 
 
+
 template <int dim>
-void Burger<dim>::setup_system ()
+void BurgerDG<dim>::run (const double final_time)
 {
-  dof_handler.distribute_dofs (fe);
+  std::cout << "Solving DG problem in " << dim << " space dimensions, nu = "
+            << nu << "." << std::endl;
 
-  std::cout << "   Number of degrees of freedom: "
-            << dof_handler.n_dofs()
-            << std::endl;
+  make_grid_and_dofs ();
+  assemble_inverse_mass_matrices ();
 
-  constraints.clear ();
-  DoFTools::make_hanging_node_constraints (dof_handler,
-                                           constraints);
+  const double output_interval = 0.01;
+  unsigned int output_number   = 0;
+  unsigned int timestep_number = 0;
+  double       time            = 0;
+  output_results (output_number);
 
-  VectorTools::interpolate_boundary_values (dof_handler,
-                                            0,
-                                            ZeroFunction<dim>(dim),
-                                            constraints);
+  Vector<double> stage (dof_handler.n_dofs());
+  Vector<double> du (dof_handler.n_dofs());
 
+  Timer timer;
+  timer.start ();
 
-  constraints.close();
+  // SSP-RK3 as in Burger::explicit_step().
+  while (time < final_time - 1e-12)
+    {
+      const double dt = std::min (compute_time_step (), final_time - time);
 
-  DynamicSparsityPattern  c_sparsity(dof_handler.n_dofs());
-  DoFTools::make_sparsity_pattern(dof_handler, c_sparsity, constraints, /*keep_constrained_dofs = */ true);
+      compute_rhs (solution, time, du);
+      stage = solution;
+      stage.add (dt, du);
 
-  sparsity_pattern.copy_from(c_sparsity);
+      compute_rhs (stage, time + dt, du);
+      stage.add (dt, du);
+      stage.sadd (0.25, 0.75, solution);
 
-  system_matrix.reinit (sparsity_pattern);
+      compute_rhs (stage, time + 0.5*dt, du);
+      stage.add (dt, du);
+      solution.sadd (1./3, 2./3, stage);
 
-  old_solution.reinit(dof_handler.n_dofs());
-  old_old_solution.reinit(dof_handler.n_dofs());
-  solution.reinit (dof_handler.n_dofs());
-  system_rhs.reinit (dof_handler.n_dofs());
+      time += dt;
+      ++timestep_number;
+
+      if (time >= (output_number + 1) * output_interval - 1e-12)
+        {
+          ++output_number;
+          output_results (output_number);
+          std::cout << "Time step " << timestep_number << " at t=" << time
+                    << ", dt=" << dt
+                    << ", max |u| = " << solution.linfty_norm ()
+                    << std::endl;
+        }
+    }
+
+  timer.stop ();
+  std::cout << timestep_number << " time steps in " << timer.wall_time ()
+            << " s." << std::endl;
 }
 
 
+
+/*
+ * Runs Burger<dim> for a list of configurations (initial global
+ * refinement, FE degree, time step) and reports the L2 error, the observed
+ * convergence rate and the wall time of each run. A time step of zero
+ * selects the stationary solver run_steady() on the uniform initial mesh,
+ * which isolates the spatial error against ExactSolution.
+ *
+ * A positive time step selects run_fixed_mesh() up to final_time, on the
+ * uniform initial mesh without remeshing. Among the configurations with the
+ * same mesh and degree, the one with the smallest time step is the
+ * reference, and the error of the others is their L2 distance to it at
+ * final_time, so it measures the time discretization alone. The reference
+ * should use a time step well below the others.
+ *
+ * The configurations are independent and run as concurrent tasks. Each
+ * writes its files with the prefix convergence-NN- and prints nothing. The
+ * wall times are taken per run and so include the contention of running
+ * side by side.
+ */
 template <int dim>
-void Burger<dim>::assemble_system_2 ()
+class ConvergenceStudy
 {
-  QGauss<dim>  quadrature_formula(2);
+public:
+  struct Configuration
+  {
+    Configuration (const unsigned int n_global_refinements,
+                   const unsigned int fe_degree = 1,
+                   const double       time_step = 0);
 
-//  const BubbleGauss<dim>  right_hand_side;
-  const RightHandSide<dim> right_hand_side(time);
-//    const ZeroFunction<dim>   right_hand_side(dim);
+    unsigned int n_global_refinements;
+    unsigned int fe_degree;
+    double       time_step;
+  };
 
-  system_matrix = 0;
-  system_rhs    = 0;
+  ConvergenceStudy (const double final_time = 0.2);
 
-  FEValues<dim> fe_values (fe, quadrature_formula,
-                           update_values   | update_gradients |
-                           update_quadrature_points | update_JxW_values);
+  void add (const Configuration &configuration);
+  void run ();
+  void write_table (std::ostream &out) const;
 
+private:
+  struct Result
+  {
+    Result ();
+
+    types::global_dof_index n_dofs;
+    double                  l2_error;
+    double                  wall_time;
+
+    // Kept until all runs are done for the time dependent configurations,
+    // whose error is measured against the reference run.
+    std::shared_ptr<Burger<dim> > burger;
+  };
+
+  void run_configuration (const unsigned int index);
+  unsigned int reference (const unsigned int index) const;
+  double observed_rate (const unsigned int index) const;
+
+  const double               final_time;
+  std::vector<Configuration> configurations;
+  std::vector<Result>        results;
+};
 
-  const unsigned int   dofs_per_cell = fe.dofs_per_cell;
-  const unsigned int   n_q_points    = quadrature_formula.size();
 
-  FullMatrix<double>   cell_matrix (dofs_per_cell, dofs_per_cell);
-  Vector<double>       cell_rhs (dofs_per_cell);
 
-  std::vector<types::global_dof_index> local_dof_indices (dofs_per_cell);
-  std::vector<Tensor<1, dim> >                 old_values (n_q_points);
-  std::vector<Tensor<1, dim> >                 old_old_values (n_q_points);
-  std::vector<Tensor<2, dim> >                 old_grad (n_q_points);
-  std::vector<double>                          old_div(n_q_points);
-  std::vector<double>                          old_old_div(n_q_points);
+template <int dim>
+ConvergenceStudy<dim>::Configuration::Configuration (const unsigned int n_global_refinements,
+                                                     const unsigned int fe_degree,
+                                                     const double       time_step)
+  :
+  n_global_refinements (n_global_refinements),
+  fe_degree (fe_degree),
+  time_step (time_step)
+{}
 
-  std::vector<Vector<double> >      rhs_values (n_q_points, Vector<double>(dim));
 
-  typename DoFHandler<dim>::active_cell_iterator
-  cell = dof_handler.begin_active(),
-  endc = dof_handler.end();
 
-  for (; cell!=endc; ++cell)
-    {
-      fe_values.reinit (cell);
+template <int dim>
+ConvergenceStudy<dim>::Result::Result ()
+  :
+  n_dofs (0),
+  l2_error (0),
+  wall_time (0)
+{}
 
-      const FEValuesViews::Vector<dim>& fe_vector_values = fe_values[FEValuesExtractors::Vector(0)];
 
-      cell_matrix = 0;
-      cell_rhs = 0;
-      fe_vector_values.get_function_values (old_solution, old_values);
-      fe_vector_values.get_function_gradients(old_solution, old_grad);
-      fe_vector_values.get_function_divergences(old_solution, old_div);
 
-      fe_vector_values.get_function_values (old_old_solution, old_old_values);
-      fe_vector_values.get_function_divergences(old_old_solution, old_old_div);
+template <int dim>
+ConvergenceStudy<dim>::ConvergenceStudy (const double final_time)
+  :
+  final_time (final_time)
+{}
 
 
-      right_hand_side.vector_value_list(fe_values.get_quadrature_points(),
-                                  rhs_values);
 
+template <int dim>
+void ConvergenceStudy<dim>::add (const Configuration &configuration)
+{
+  configurations.push_back (configuration);
+}
 
-      for (unsigned int q_index=0; q_index<n_q_points; ++q_index){
 
 
-          Tensor<1, dim> rhs_val;
+template <int dim>
+void ConvergenceStudy<dim>::run ()
+{
+  results.clear ();
+  results.resize (configurations.size());
+
+  Threads::TaskGroup<> tasks;
+  for (unsigned int i=0; i<configurations.size(); ++i)
+    tasks += Threads::new_task (&ConvergenceStudy<dim>::run_configuration,
+                                *this, i);
+  tasks.join_all ();
+
+  for (unsigned int i=0; i<configurations.size(); ++i)
+    if (configurations[i].time_step > 0)
+      {
+        const unsigned int j = reference (i);
+        results[i].l2_error = (j == i
+                               ? std::numeric_limits<double>::quiet_NaN ()
+                               : results[i].burger->compute_l2_difference (*results[j].burger));
+      }
+  for (unsigned int i=0; i<results.size(); ++i)
+    results[i].burger.reset ();
+}
 
-          for (int d = 0; d < dim; ++d) {
-            rhs_val[d] += right_hand_side.value(fe_values.quadrature_point(q_index), d);
-          }
 
-    	  const double& u_star_div = old_div[q_index]; //2*old_div[q_index]    - old_old_div[q_index] ;
-    	  const Tensor<1, dim>& u_star     = old_values[q_index]; //2*old_values[q_index] - old_old_values[q_index];
 
-        for (unsigned int i=0; i<dofs_per_cell; ++i)
-          {
-            const Tensor<1, dim>& u_val   = fe_vector_values.value(i, q_index);
-            const Tensor<2, dim>& u_grad  = fe_vector_values.gradient(i, q_index);
+template <int dim>
+unsigned int ConvergenceStudy<dim>::reference (const unsigned int index) const
+{
+  // The time dependent configuration with the same mesh and degree and the
+  // smallest time step.
+  unsigned int reference = index;
+  for (unsigned int j=0; j<configurations.size(); ++j)
+    if ((configurations[j].n_global_refinements == configurations[index].n_global_refinements) &&
+        (configurations[j].fe_degree == configurations[index].fe_degree) &&
+        (configurations[j].time_step > 0) &&
+        (configurations[j].time_step < configurations[reference].time_step))
+      reference = j;
+  return reference;
+}
+
 
-            for (unsigned int j=0; j<dofs_per_cell; ++j) {
 
-                const Tensor<1, dim>& v_val   = fe_vector_values.value(j, q_index);
-                const Tensor<2, dim>& v_grad  = fe_vector_values.gradient(j, q_index);
+template <int dim>
+void ConvergenceStudy<dim>::run_configuration (const unsigned int index)
+{
+  const Configuration &configuration = configurations[index];
 
-              cell_matrix(i,j) += ( u_val * v_val //0.5*(3*u_val * v_val)
-            		               +
-            		               time_step*contract3(u_star, u_grad, v_val)//u_star*u_grad*v_val
-            		               +
-            		               0.5*time_step*u_star_div*contract(u_val, v_val)
-            		               +
-            		               nu*time_step*double_contract(u_grad, v_grad)
-                                       )*fe_values.JxW (q_index);
-            }
-            				//2.0*old_values[q_index]* u_val - 0.5*old_old_values[q_index]* u_val
-            cell_rhs(i) += (old_values[q_index]* u_val  + time_step * (rhs_val * u_val)
-                               )* fe_values.JxW (q_index);
-          }
-      }
-      cell->get_dof_indices (local_dof_indices);
-     constraints.distribute_local_to_global(cell_matrix,
-                                          cell_rhs,
-                                          local_dof_indices,
-                                          system_matrix,
-                                          system_rhs);
+  Timer timer;
+  timer.start ();
 
+  std::shared_ptr<Burger<dim> > burger
+    = std::make_shared<Burger<dim> > (configuration.n_global_refinements,
+                                      configuration.fe_degree);
+  burger->set_verbose (false);
+  burger->set_output_prefix ("convergence-" + Utilities::int_to_string (index, 2) + "-");
+  if (configuration.time_step > 0)
+    {
+      burger->set_time_step (configuration.time_step);
+      burger->run_fixed_mesh (final_time);
+      results[index].burger = burger;
+    }
+  else
+    {
+      burger->run_steady (0);
+      results[index].l2_error = burger->compute_l2_error ();
     }
 
+  results[index].n_dofs    = burger->n_dofs ();
+  results[index].wall_time = timer.wall_time ();
+}
 
-//  BoundaryValues<dim> boundary_values_function;
-//  boundary_values_function.set_time(time);
 
-  std::map<types::global_dof_index,double> boundary_values;
-  VectorTools::interpolate_boundary_values (dof_handler,
-                                            0,
-                                            ZeroFunction<dim>(dim),
-                                            boundary_values);
-  MatrixTools::apply_boundary_values (boundary_values,
-                                      system_matrix,
-                                      solution,
-                                      system_rhs);
 
+template <int dim>
+double ConvergenceStudy<dim>::observed_rate (const unsigned int index) const
+{
+  // Rate with respect to the closest earlier configuration that differs in
+  // the mesh only, measured in h ~ n_dofs^{-1/dim}, or in the time step
+  // only.
+  const Configuration &current = configurations[index];
+  for (unsigned int j=index; j-- > 0; )
+    {
+      const Configuration &previous = configurations[j];
+      if (previous.fe_degree != current.fe_degree)
+        continue;
+
+      const double error_ratio = results[j].l2_error / results[index].l2_error;
+      if ((previous.time_step == current.time_step) &&
+          (previous.n_global_refinements != current.n_global_refinements))
+        return std::log (error_ratio) /
+               std::log (std::pow (double(results[index].n_dofs) / results[j].n_dofs, 1./dim));
+      if ((previous.n_global_refinements == current.n_global_refinements) &&
+          (previous.time_step > 0) && (current.time_step > 0) &&
+          (previous.time_step != current.time_step))
+        return std::log (error_ratio) / std::log (previous.time_step / current.time_step);
+    }
+  return std::numeric_limits<double>::quiet_NaN ();
 }
 
 
+
 template <int dim>
-void Burger<dim>::solve ()
+void ConvergenceStudy<dim>::write_table (std::ostream &out) const
 {
-/*  SolverControl           solver_control (1000, 1e-8 * system_rhs.l2_norm());
-  SolverCG<>              solver (solver_control);
+  const std::ios_base::fmtflags flags     = out.flags ();
+  const std::streamsize         precision = out.precision ();
 
-  PreconditionSSOR<> preconditioner;//PreconditionIdentity()
-  preconditioner.initialize(system_matrix, 1.0);
+  out << "# refinements  degree   time_step    n_dofs    L2_error   rate  wall_time[s]\n";
+  for (unsigned int i=0; i<results.size(); ++i)
+    {
+      const double rate = observed_rate (i);
 
-  solver.solve (system_matrix, solution, system_rhs,
-                preconditioner);
+      out << std::setw(13) << configurations[i].n_global_refinements
+          << std::setw(8)  << configurations[i].fe_degree;
+      if (configurations[i].time_step > 0)
+        out << std::setw(12) << configurations[i].time_step;
+      else
+        out << std::setw(12) << "steady";
+      out << std::setw(10) << results[i].n_dofs;
+      if (results[i].l2_error == results[i].l2_error)
+        out << std::setw(12) << std::scientific << std::setprecision(3) << results[i].l2_error;
+      else
+        out << std::setw(12) << "reference";
+      out << std::fixed << std::setprecision(2);
+      if (rate == rate)
+        out << std::setw(7) << rate;
+      else
+        out << std::setw(7) << "-";
+      out << std::setw(14) << results[i].wall_time << '\n';
+      out.flags (flags);
+      out.precision (precision);
+    }
+  out.flush ();
+}
 
-*/
-	int    vel_max_its     = 5000;
-	double vel_eps         = 1e-9;
-	int    vel_Krylov_size = 30;
 
-  PreconditionSSOR<> preconditioner;
-  preconditioner.initialize(system_matrix, 1.0);
 
-	SolverControl solver_control (vel_max_its, vel_eps*system_rhs.l2_norm());
-	{
-		SolverGMRES<Vector<double>> gmres1 (solver_control,
-						   SolverGMRES<>::AdditionalData (vel_Krylov_size));
-		gmres1.solve (system_matrix, solution, system_rhs, preconditioner);
-	}
+/*
+ * Benchmark suite: the kernel timings of Burger::run_benchmarks() on a
+ * small 2d and 3d mesh, and two small end-to-end runs. The timings are
+ * compared with the baseline file. Any entry slower than the baseline
+ * by more than the threshold is reported as a regression, and the
+ * function returns nonzero. If the baseline does not exist yet, or
+ * update_baseline is set, the current timings are written as the new
+ * baseline. Baselines only make sense on the machine they were taken on.
+ */
+int run_benchmark_suite (const std::string &baseline_file,
+                         const bool         update_baseline,
+                         const double       threshold = 0.2)
+{
+  std::vector<std::pair<std::string, double> > timings;
+  {
+    Burger<2> burger (4);
+    burger.set_verbose (false);
+    burger.set_output_prefix ("benchmark-2d-");
+    const std::vector<std::pair<std::string, double> > t = burger.run_benchmarks (5);
+    for (unsigned int i=0; i<t.size(); ++i)
+      timings.push_back (std::make_pair ("2d_" + t[i].first, t[i].second));
+  }
+  {
+    Burger<3> burger (2);
+    burger.set_verbose (false);
+    burger.set_output_prefix ("benchmark-3d-");
+    const std::vector<std::pair<std::string, double> > t = burger.run_benchmarks (5);
+    for (unsigned int i=0; i<t.size(); ++i)
+      timings.push_back (std::make_pair ("3d_" + t[i].first, t[i].second));
+  }
+  {
+    Timer timer;
+    timer.start ();
+    Burger<2> burger (2);
+    burger.set_verbose (false);
+    burger.set_output_prefix ("benchmark-steady-");
+    burger.run_steady (1);
+    timings.push_back (std::make_pair ("2d_steady_run", timer.wall_time ()));
+  }
+  {
+    Timer timer;
+    timer.start ();
+    Burger<2> burger (2);
+    burger.set_verbose (false);
+    burger.set_output_prefix ("benchmark-transient-");
+    burger.set_option ("snapshot_interval", "0");
+    burger.set_time_step (1./20);
+    burger.run ();
+    timings.push_back (std::make_pair ("2d_transient_run", timer.wall_time ()));
+  }
+
+  {
+    // Ten time steps of the 3d cavity on a fixed mesh.
+    Timer timer;
+    timer.start ();
+    Burger<3> burger (3);
+    burger.set_verbose (false);
+    burger.run_fixed_mesh (10./500);
+    timings.push_back (std::make_pair ("3d_fixed_mesh_ssor", timer.wall_time ()));
+  }
+  {
+    // The explicit scheme to the same time, with its CFL limited steps.
+    Timer timer;
+    timer.start ();
+    Burger<2> burger (5);
+    burger.set_verbose (false);
+    burger.set_option ("time_integration", "ssp_rk3");
+    burger.run_fixed_mesh (10./500);
+    timings.push_back (std::make_pair ("2d_fixed_mesh_ssp_rk3", timer.wall_time ()));
+  }
+  {
+    // IMEX BDF2 with UMFPACK factorizes its constant matrix once, implicit
+    // Euler in every step.
+    const char *schemes[] = { "implicit_euler", "imex_bdf2" };
+    for (unsigned int i=0; i<2; ++i)
+      {
+        Timer timer;
+        timer.start ();
+        Burger<2> burger (5);
+        burger.set_verbose (false);
+        burger.set_option ("time_integration", schemes[i]);
+        burger.set_option ("linear_solver", "direct_umfpack");
+        burger.run_fixed_mesh (10./500);
+        timings.push_back (std::make_pair (std::string ("2d_fixed_mesh_umfpack_") + schemes[i],
+                                           timer.wall_time ()));
+      }
+  }
+  {
+    // Ten time steps on a fixed mesh, with either preconditioner.
+    const char *preconditioners[] = { "ssor", "multigrid" };
+    for (unsigned int i=0; i<2; ++i)
+      {
+        Timer timer;
+        timer.start ();
+        Burger<2> burger (5);
+        burger.set_verbose (false);
+        burger.set_option ("preconditioner", preconditioners[i]);
+        burger.run_fixed_mesh (10./500);
+        timings.push_back (std::make_pair (std::string ("2d_fixed_mesh_") + preconditioners[i],
+                                           timer.wall_time ()));
+      }
+  }
 
+  std::map<std::string, double> baseline;
+  {
+    std::ifstream in (baseline_file.c_str());
+    std::string   name;
+    double        seconds;
+    while (in >> name >> seconds)
+      baseline[name] = seconds;
+  }
 
+  unsigned int n_regressions = 0;
+  std::cout << std::setw(28) << std::left << "# benchmark" << std::right
+            << std::setw(14) << "time[s]" << std::setw(14) << "baseline[s]"
+            << std::setw(10) << "ratio" << std::endl;
+  for (unsigned int i=0; i<timings.size(); ++i)
+    {
+      std::cout << std::setw(28) << std::left << timings[i].first << std::right
+                << std::setw(14) << std::scientific << std::setprecision(3) << timings[i].second;
 
-  std::cout << "   " << solver_control.last_step()
-            << " GMRES iterations needed to obtain convergence."
-            << std::endl;
+      const std::map<std::string, double>::const_iterator reference = baseline.find (timings[i].first);
+      if (reference == baseline.end())
+        std::cout << std::setw(14) << "-" << std::setw(10) << "-";
+      else
+        {
+          const double ratio = timings[i].second / reference->second;
+          std::cout << std::setw(14) << reference->second
+                    << std::setw(10) << std::fixed << std::setprecision(2) << ratio;
+          if (ratio > 1 + threshold)
+            {
+              std::cout << "  REGRESSION";
+              ++n_regressions;
+            }
+        }
+      std::cout << std::endl;
+    }
 
-  constraints.distribute (solution);
+  if (update_baseline || baseline.empty())
+    {
+      std::ofstream out (baseline_file.c_str());
+      out << std::scientific << std::setprecision(6);
+      for (unsigned int i=0; i<timings.size(); ++i)
+        out << timings[i].first << ' ' << timings[i].second << '\n';
+      std::cout << "Baseline written to " << baseline_file << std::endl;
+      return 0;
+    }
+
+  std::cout << n_regressions << " regression(s) beyond "
+            << int(100 * threshold) << " %." << std::endl;
+  return (n_regressions > 0 ? 1 : 0);
 }
 
-template <int dim>
-void Burger<dim>::refine_grid(const unsigned int min_grid_level,
-		                     const unsigned int max_grid_level){
 
-	Vector<float> estimated_error_per_cell(triangulation.n_active_cells());
 
-	KellyErrorEstimator<dim>::estimate(dof_handler,
-			                            QGauss<dim-1>(fe.degree+2),
-			                            typename FunctionMap<dim>::type(),
-			                            solution,
-			                            estimated_error_per_cell);
 /*
-	GridRefinement::refine_and_coarsen_fixed_number(triangulation,
-			                                         estimated_error_per_cell,
-			                                         0.6, 0.4);
-	*/
+ * Direct against iterative solution over a range of meshes: the wall time
+ * per time step of five fixed-mesh steps with GMRES and SSOR, with UMFPACK
+ * (Cuthill-McKee numbering, refactorized every step with implicit Euler),
+ * and with UMFPACK under IMEX BDF2 (factorized once), for each number of
+ * global refinements from min_refinements to max_refinements.
+ */
+template <int dim>
+void run_solver_sweep (const unsigned int min_refinements,
+                       const unsigned int max_refinements,
+                       std::ostream      &out)
+{
+  const char *solvers[] = { "gmres", "direct_umfpack", "direct_umfpack" };
+  const char *schemes[] = { "implicit_euler", "implicit_euler", "imex_bdf2" };
+  const unsigned int n_time_steps = 5;
 
-    GridRefinement::refine_and_coarsen_fixed_number (triangulation,
-                                                       estimated_error_per_cell,
-                                                       0.5, 0.2);
+  out << "# dim  refinements    n_dofs  gmres_ssor[s]  umfpack[s]  umfpack_imex[s]" << std::endl;
+  for (unsigned int refinements=min_refinements; refinements<=max_refinements; ++refinements)
+    {
+      types::global_dof_index n_dofs = 0;
+      double                  step_time[3];
+      for (unsigned int i=0; i<3; ++i)
+        {
+          Timer timer;
+          timer.start ();
+          Burger<dim> burger (refinements);
+          burger.set_verbose (false);
+          burger.set_option ("linear_solver", solvers[i]);
+          burger.set_option ("time_integration", schemes[i]);
+          burger.run_fixed_mesh (n_time_steps / 500.);
+          step_time[i] = timer.wall_time () / n_time_steps;
+          n_dofs       = burger.n_dofs ();
+        }
+
+      out << std::setw(5) << dim << std::setw(13) << refinements
+          << std::setw(10) << n_dofs << std::scientific << std::setprecision(3)
+          << std::setw(15) << step_time[0] << std::setw(12) << step_time[1]
+          << std::setw(17) << step_time[2] << std::endl;
+      out.unsetf (std::ios_base::floatfield);
+    }
+}
 
-	if(triangulation.n_levels() > max_grid_level){
-		for(typename Triangulation<dim>::active_cell_iterator
-				cell = triangulation.begin_active(max_grid_level);
-				cell != triangulation.end(); ++cell){
-			cell->clear_refine_flag();
-		}
-	}
-	for(typename Triangulation<dim>::active_cell_iterator
-			cell = triangulation.begin_active(min_grid_level);
-			cell != triangulation.end_active(min_grid_level); ++cell)
-		cell->clear_coarsen_flag();
 
-	SolutionTransfer<dim> solution_transfer(dof_handler);
 
-	Vector<double> previous_solution;
-	previous_solution = solution;
+/*
+ * Functional checks, run with "Burger check <name>" and registered as
+ * CTest tests. Each prints what it compared and returns nonzero on
+ * failure.
+ *
+ * check_point_sampling() compares CellLocator::sample() with
+ * VectorTools::point_value() for a Q2 field on a mesh with hanging nodes,
+ * at a few thousand quasi-random points.
+ */
+template <int dim>
+int check_point_sampling ()
+{
+  Triangulation<dim> triangulation;
+  GridGenerator::hyper_cube (triangulation, -1, 1);
+  triangulation.refine_global (3);
+  for (typename Triangulation<dim>::active_cell_iterator
+       cell = triangulation.begin_active(); cell != triangulation.end(); ++cell)
+    if (cell->center().norm() < 0.5)
+      cell->set_refine_flag ();
+  triangulation.execute_coarsening_and_refinement ();
+
+  FESystem<dim>   fe (FE_Q<dim>(2), dim);
+  DoFHandler<dim> dof_handler (triangulation);
+  dof_handler.distribute_dofs (fe);
 
+  ConstraintMatrix constraints;
+  DoFTools::make_hanging_node_constraints (dof_handler, constraints);
+  constraints.close ();
 
-	triangulation.prepare_coarsening_and_refinement();
-	solution_transfer.prepare_for_coarsening_and_refinement(previous_solution);
+  Vector<double> solution (dof_handler.n_dofs());
+  VectorTools::interpolate (dof_handler, ExactSolution<dim>(), solution);
+  constraints.distribute (solution);
 
+  // Additive recurrence with irrational increments sqrt(2), sqrt(3) and
+  // sqrt(5), which fills the domain evenly without a random generator.
+  const double increments[] = { std::sqrt (2.), std::sqrt (3.), std::sqrt (5.) };
+  std::vector<Point<dim> > points (4000);
+  for (unsigned int p=0; p<points.size(); ++p)
+    for (unsigned int d=0; d<dim; ++d)
+      points[p][d] = -0.99 + 1.98 * std::fmod ((p+1) * increments[d], 1.);
+
+  CellLocator<dim> locator (triangulation);
+  locator.update ();
+
+  Timer timer;
+  timer.start ();
+  std::vector<Vector<double> > values;
+  locator.sample (dof_handler, solution, points, values);
+  const double sample_time = timer.wall_time ();
+
+  double         max_difference = 0;
+  Vector<double> reference (dim);
+  for (unsigned int p=0; p<points.size(); ++p)
+    {
+      VectorTools::point_value (dof_handler, solution, points[p], reference);
+      reference -= values[p];
+      max_difference = std::max (max_difference, reference.linfty_norm ());
+    }
 
-	triangulation.execute_coarsening_and_refinement();
-	setup_system();
+  std::cout << "Point sampling in " << dim << "d: " << points.size()
+            << " points in " << sample_time << " s, maximal difference to"
+            << " VectorTools::point_value " << max_difference << std::endl;
+  return (max_difference < 1e-10 ? 0 : 1);
+}
 
-	solution_transfer.interpolate(previous_solution, solution);
 
-	constraints.distribute(solution);
 
-}
+/*
+ * check_cell_kernels() compares the specialized cell matrices of
+ * ConvectionDiffusion::vector_burgers_cell_matrix() with the generic loop
+ * over VectorBurgers::operator_entry(), for Q1 and Q2 with both Gauss rules
+ * that have a kernel, on distorted cells and with a varying u*.
+ */
+template <int dim>
+int check_cell_kernels ()
+{
+  Triangulation<dim> triangulation;
+  GridGenerator::hyper_cube (triangulation, -1, 1);
+  triangulation.refine_global (2);
+  GridTools::distort_random (0.2, triangulation);
+
+  const double       nu        = 0.01;
+  const double       time_step = 0.05;
+  const double       increments[] = { std::sqrt (2.), std::sqrt (3.), std::sqrt (5.) };
+  const FEValuesExtractors::Vector velocities (0);
+
+  double max_difference = 0;
+  bool   all_specialized = true;
+  for (unsigned int degree=1; degree<=2; ++degree)
+    for (unsigned int n_gauss_points=degree+1; n_gauss_points<=degree+2; ++n_gauss_points)
+      {
+        FESystem<dim>   fe (FE_Q<dim>(degree), dim);
+        DoFHandler<dim> dof_handler (triangulation);
+        dof_handler.distribute_dofs (fe);
+
+        const QGauss<dim>  quadrature_formula (n_gauss_points);
+        FEValues<dim>      fe_values (fe, quadrature_formula,
+                                      update_values | update_gradients | update_JxW_values);
+        const unsigned int dofs_per_cell = fe.dofs_per_cell;
+        const unsigned int n_q_points    = quadrature_formula.size();
+
+        FullMatrix<double>           kernel_matrix (dofs_per_cell, dofs_per_cell);
+        FullMatrix<double>           generic_matrix (dofs_per_cell, dofs_per_cell);
+        std::vector<Tensor<1, dim> > u_star (n_q_points);
+        std::vector<double>          u_star_div (n_q_points);
+
+        unsigned int sample = 0;
+        typename DoFHandler<dim>::active_cell_iterator
+        cell = dof_handler.begin_active(),
+        endc = dof_handler.end();
+        for (; cell!=endc; ++cell)
+          {
+            fe_values.reinit (cell);
+            const FEValuesViews::Vector<dim> &fe_vector_values = fe_values[velocities];
+
+            for (unsigned int q=0; q<n_q_points; ++q, ++sample)
+              {
+                for (unsigned int d=0; d<dim; ++d)
+                  u_star[q][d] = 2 * std::fmod ((sample+1) * increments[d], 1.) - 1;
+                u_star_div[q] = 2 * std::fmod ((sample+1) * increments[2], 1.) - 1;
+              }
+
+            kernel_matrix = 0;
+            all_specialized &= ConvectionDiffusion::vector_burgers_cell_matrix
+                               (fe_values, u_star, u_star_div, nu, time_step, kernel_matrix);
+
+            generic_matrix = 0;
+            for (unsigned int q=0; q<n_q_points; ++q)
+              for (unsigned int i=0; i<dofs_per_cell; ++i)
+                for (unsigned int j=0; j<dofs_per_cell; ++j)
+                  generic_matrix(i,j) += ConvectionDiffusion::VectorBurgers<dim>::operator_entry
+                                         (nu, time_step, u_star[q], u_star_div[q],
+                                          fe_vector_values.value (i, q),
+                                          fe_vector_values.gradient (i, q),
+                                          fe_vector_values.value (j, q),
+                                          fe_vector_values.gradient (j, q))
+                                         * fe_values.JxW (q);
+
+            kernel_matrix.add (-1., generic_matrix);
+            max_difference = std::max (max_difference,
+                                       kernel_matrix.linfty_norm () / generic_matrix.linfty_norm ());
+          }
+      }
 
+  std::cout << "Cell kernels in " << dim << "d: "
+            << (all_specialized ? "all" : "not all") << " configurations specialized,"
+            << " maximal relative difference to the generic operator "
+            << max_difference << std::endl;
+  return (all_specialized && (max_difference < 1e-12) ? 0 : 1);
+}
 
 
-template <int dim>
-void Burger<dim>::output_results () const
-{    /*
-    DataOut<dim> data_out;
-    data_out.attach_dof_handler(dof_handler);
-    data_out.add_data_vector(solution, "velocity");
-    data_out.build_patches();
-    const std::string filename = "solution-"
-                                 + Utilities::int_to_string(timestep_number, 3) +
-                                 ".vtk";
-    std::ofstream output(filename.c_str());
-    data_out.write_vtk(output);
 
+/*
+ * check_recycling() runs the same time steps on a fixed mesh with GMRES
+ * and with recycling GMRES, and requires the recycled directions to save
+ * linear iterations over the steps.
  */
+int check_recycling ()
+{
+  const char        *solvers[] = { "gmres", "recycling_gmres" };
+  unsigned int       n_iterations[2];
+  for (unsigned int i=0; i<2; ++i)
+    {
+      Burger<2> burger (5);
+      burger.set_verbose (false);
+      burger.set_option ("linear_solver", solvers[i]);
+      n_iterations[i] = burger.run_fixed_mesh (20./500);
+    }
 
-    std::vector<std::string> solution_names (dim, "velocity");
+  std::cout << "Linear iterations in 20 time steps: " << n_iterations[0]
+            << " with GMRES, " << n_iterations[1] << " with recycling GMRES"
+            << std::endl;
+  return (n_iterations[1] < n_iterations[0] ? 0 : 1);
+}
 
-    std::vector<DataComponentInterpretation::DataComponentInterpretation>
-    data_component_interpretation
-    (dim, DataComponentInterpretation::component_is_part_of_vector);
 
-    DataOut<dim> data_out;
-    data_out.attach_dof_handler (dof_handler);
-    data_out.add_data_vector (solution, solution_names,
-                              DataOut<dim>::type_dof_data,
-                              data_component_interpretation);
-    data_out.build_patches ();
-    std::ostringstream filename;
-    filename << "solution-"
-             << Utilities::int_to_string (timestep_number, 3)
-             << ".vtk";
-    std::ofstream output (filename.str().c_str());
-    data_out.write_vtk (output);
-}
 
+/*
+ * check_initial_guesses() counts the linear iterations of the same time
+ * steps for every initial guess strategy. Each warm start has to need at
+ * most as many as the zero guess, and the extrapolated one fewer.
+ */
+int check_initial_guesses ()
+{
+  const char  *guesses[] = { "zero", "previous", "extrapolated", "projected" };
+  unsigned int n_iterations[4];
+  for (unsigned int i=0; i<4; ++i)
+    {
+      Burger<2> burger (4);
+      burger.set_verbose (false);
+      burger.set_option ("initial_guess", guesses[i]);
+      n_iterations[i] = burger.run_fixed_mesh (20./500);
+      std::cout << "Linear iterations in 20 time steps with the " << guesses[i]
+                << " guess: " << n_iterations[i] << std::endl;
+    }
+
+  return ((n_iterations[1] <= n_iterations[0]) &&
+          (n_iterations[2] <  n_iterations[0]) &&
+          (n_iterations[3] <= n_iterations[0])) ? 0 : 1;
+}
 
 
 
-template <int dim>
-void Burger<dim>::run ()
+/*
+ * check_multigrid() solves three time steps on a fixed mesh with GMRES and
+ * the multigrid preconditioner, with either smoother, and compares the
+ * result with the one of the SSOR preconditioner. Both solve to a relative
+ * residual of 1e-9, so they have to agree far below the solution's size.
+ */
+int check_multigrid ()
 {
-  std::cout << "Solving problem in " << dim << " space dimensions." << std::endl;
+  const double final_time = 3./500;
 
-  std::ofstream error_out;
-  error_out.open("l2_error.dat");
+  Burger<2> ssor_burger (4);
+  ssor_burger.set_verbose (false);
+  const unsigned int ssor_iterations = ssor_burger.run_fixed_mesh (final_time);
 
+  const double solution_norm = ssor_burger.compute_solution_norm ();
 
-  make_grid();
-  setup_system ();
-  const BubbleGauss<dim> bubble_gum;
-  unsigned int pre_refinement_step = 0;
-  const unsigned int n_adaptive_pre_refinement_steps = 4;
-  const unsigned int initial_global_refinement = 2;
+  const char *smoothers[] = { "chebyshev", "jacobi" };
+  bool        agree       = (solution_norm > 0);
+  for (unsigned int i=0; i<2; ++i)
+    {
+      Burger<2> mg_burger (4);
+      mg_burger.set_verbose (false);
+      mg_burger.set_option ("preconditioner", "multigrid");
+      mg_burger.set_option ("mg_smoother", smoothers[i]);
+      const unsigned int mg_iterations = mg_burger.run_fixed_mesh (final_time);
+      const double       difference    = mg_burger.compute_l2_difference (ssor_burger) / solution_norm;
+
+      std::cout << "Multigrid with the " << smoothers[i] << " smoother: "
+                << mg_iterations << " iterations (SSOR: " << ssor_iterations
+                << "), relative difference to the SSOR solution "
+                << difference << std::endl;
+      agree = agree && (difference < 1e-6);
+    }
 
-  Vector<float> difference_per_cell (triangulation.n_active_cells());
-  double L2_error ;
-  ExactSolution<dim> exact_sol;
-  const ComponentSelectFunction<dim> velocity_mask(std::make_pair(0, dim), dim);
+  return (agree ? 0 : 1);
+}
 
 
-start_time_iteration:
 
-  timestep_number = 0;
-  time            = 0;
+/*
+ * check_explicit() runs the explicit SSP-RK3 scheme with its CFL limited
+ * steps and implicit Euler with a much smaller step to the same time,
+ * while the cavity forcing is constant in time. The two differ by the
+ * time discretization error of implicit Euler and the mass lumping of the
+ * explicit scheme, which are both small here.
+ */
+int check_explicit ()
+{
+  const double final_time = 0.02;
+
+  Burger<2> implicit_burger (4);
+  implicit_burger.set_verbose (false);
+  implicit_burger.set_time_step (1./20000);
+  implicit_burger.run_fixed_mesh (final_time);
+
+  Burger<2> explicit_burger (4);
+  explicit_burger.set_verbose (false);
+  explicit_burger.set_option ("time_integration", "ssp_rk3");
+  explicit_burger.run_fixed_mesh (final_time);
+
+  const double solution_norm = implicit_burger.compute_solution_norm ();
+  const double difference    = explicit_burger.compute_l2_difference (implicit_burger) / solution_norm;
+  std::cout << "SSP-RK3 against implicit Euler at t=" << final_time
+            << ": relative difference " << difference << std::endl;
+  return ((solution_norm > 0) && (difference < 5e-2) ? 0 : 1);
+}
 
-  /*
-  VectorTools::interpolate(dof_handler,
-		  	  	  	       ZeroFunction<dim>(dim),
-                           old_solution);
 
-*/
-  VectorTools::project (dof_handler,
-                        constraints,
-                        QGauss<dim>(2),
-                        ZeroFunction<dim>(dim),//bubble_gum,
-                        old_solution);
 
-  solution = old_solution;
-  output_results();
-//  old_solution = 0;
-//  solution     = 0;
+/*
+ * check_imex() runs implicit Euler and IMEX BDF2 to the same time at two
+ * time steps. Both are consistent, so their difference has to be small
+ * and shrink at least linearly with the time step. IMEX runs with UMFPACK,
+ * whose factorization of the constant IMEX matrix is computed once and
+ * reused in every step.
+ */
+int check_imex ()
+{
+  const double final_time = 0.02;
+  const double time_steps[] = { 1./500, 1./1000 };
 
-   do{
+  double difference[2];
+  for (unsigned int i=0; i<2; ++i)
+    {
+      Burger<2> implicit_burger (4);
+      implicit_burger.set_verbose (false);
+      implicit_burger.set_time_step (time_steps[i]);
+      implicit_burger.run_fixed_mesh (final_time);
+
+      Burger<2> imex_burger (4);
+      imex_burger.set_verbose (false);
+      imex_burger.set_time_step (time_steps[i]);
+      imex_burger.set_option ("time_integration", "imex_bdf2");
+      imex_burger.set_option ("linear_solver", "direct_umfpack");
+      imex_burger.run_fixed_mesh (final_time);
+
+      difference[i] = imex_burger.compute_l2_difference (implicit_burger)
+                      / implicit_burger.compute_solution_norm ();
+      std::cout << "IMEX BDF2 against implicit Euler with time step " << time_steps[i]
+                << ": relative difference " << difference[i] << std::endl;
+    }
 
-      std::cout << "Time step " << timestep_number << " at t=" << time
-                << std::endl;
+  return ((difference[0] < 5e-2) && (difference[1] < 0.7 * difference[0])) ? 0 : 1;
+}
 
-      assemble_system_2 ();
 
-      solve ();
-      output_results ();
 
-      if((timestep_number ==1)&& (pre_refinement_step < n_adaptive_pre_refinement_steps)){
+/*
+ * check_cell_budget() runs the cavity with the cell_budget strategy and
+ * indicator-triggered remeshing, and requires the number of DoFs to stay
+ * within 30 % of target_n_dofs after the pre-refinement.
+ */
+int check_cell_budget ()
+{
+  const unsigned int target_n_dofs = 4000;
+
+  Burger<2> burger (3);
+  burger.set_verbose (false);
+  burger.set_output_prefix ("check-budget-");
+  burger.set_option ("refinement_strategy", "cell_budget");
+  burger.set_option ("target_n_dofs", Utilities::int_to_string (target_n_dofs));
+  burger.set_option ("snapshot_interval", "0");
+  burger.set_time_step (1./50);
+  burger.run ();
+
+  const std::pair<types::global_dof_index, types::global_dof_index> range = burger.n_dofs_range ();
+  std::cout << "Cell budget of " << target_n_dofs << " DoFs: between "
+            << range.first << " and " << range.second << " DoFs" << std::endl;
+  return ((range.first >= 0.7 * target_n_dofs) &&
+          (range.second <= 1.3 * target_n_dofs)) ? 0 : 1;
+}
 
-    	  refine_grid(initial_global_refinement,
-    			  initial_global_refinement + n_adaptive_pre_refinement_steps);
-    	  ++pre_refinement_step;
-    	  old_old_solution.reinit(solution.size());
-    	  old_solution.reinit(solution.size());
-    	  system_rhs.reinit(solution.size());
 
-    	  goto start_time_iteration;
 
-      }
-      else if ((timestep_number > 0) && (timestep_number % 5 == 0)){
+/*
+ * check_step_allocations() requires a time step of
+ * Burger::count_time_step_allocations() with the default settings to be
+ * free of heap allocations. It needs the counting operator new of
+ * allocation_counter.cc, preloaded by the check-allocations test.
+ */
+int check_step_allocations ()
+{
+  if (!AllocationCounter::enabled ())
+    {
+      std::cout << "Allocations are only counted with the allocation_counter module preloaded." << std::endl;
+      return 1;
+    }
 
-    	  refine_grid(initial_global_refinement,
-    			  initial_global_refinement + n_adaptive_pre_refinement_steps);
-    	  old_old_solution.reinit(solution.size());
-     	  old_solution.reinit(solution.size());
-          system_rhs.reinit(solution.size());
-      }
-      time += time_step;
-      ++timestep_number;
+  Burger<2> burger (3);
+  burger.set_verbose (false);
+  burger.set_output_prefix ("check-allocations-");
+  const std::size_t n_allocations = burger.count_time_step_allocations ();
 
-      VectorTools::integrate_difference (dof_handler,
-                                         solution,
-                                         exact_sol,
-                                         difference_per_cell,
-                                         QGauss<dim>(3),
-                                         VectorTools::L2_norm,
-                                         &velocity_mask);
-      L2_error = difference_per_cell.l2_norm();
-      error_out << time <<"  "<<L2_error << std::endl;
+  std::cout << "Heap allocations in a time step with the default settings: "
+            << n_allocations << std::endl;
+  return (n_allocations == 0 ? 0 : 1);
+}
 
-      old_old_solution = old_solution;
-      old_solution = solution;
-      solution = 0;
-  }while (time <= 1.0);
 
 
+/*
+ * Passes arguments of the form name=value to Burger::set_option().
+ */
+template <int dim>
+void set_options (Burger<dim>                    &burger,
+                  const std::vector<std::string> &options)
+{
+  for (unsigned int i=0; i<options.size(); ++i)
+    {
+      const std::string::size_type separator = options[i].find ('=');
+      burger.set_option (options[i].substr (0, separator),
+                         options[i].substr (separator + 1));
+    }
 }
 
 
 
-int main ()
+int main (int argc, char **argv)
 {
 
   try
     {
       using namespace dealii;
       deallog.depth_console(0);
+      BURGER_PERF_INIT;
+
+      // Usage: Burger [dim [n_global_refinements [stabilization]]] [name=value ...]
+      //        Burger ensemble
+      //        Burger forcings
+      //        Burger dg [n_global_refinements [nu]]
+      //        Burger steady [n_global_refinements]
+      //        Burger compare-solvers [n_global_refinements]
+      //        Burger convergence
+      //        Burger solver-sweep [max_refinements]
+      //        Burger benchmark [baseline_file [update]]
+      //        Burger check sampling|kernels|recycling|guesses|multigrid|explicit|
+      //                     imex|budget|allocations
+      //
+      // Arguments of the form name=value may appear anywhere; they are
+      // options of Burger::set_option() for the modes that run a Burger
+      // object directly, and are taken out before the others are read.
+      std::vector<std::string> options;
+      {
+        int n_positional = 1;
+        for (int i=1; i<argc; ++i)
+          if (std::string (argv[i]).find ('=') != std::string::npos)
+            options.push_back (argv[i]);
+          else
+            argv[n_positional++] = argv[i];
+        argc = n_positional;
+      }
 
-      Burger<2> burger_equation_solver;
-      burger_equation_solver.run();
+      if ((argc > 2) && (std::string (argv[1]) == "check"))
+        {
+          const std::string name (argv[2]);
+          if (name == "sampling")
+            return ((check_point_sampling<2> () == 0) &&
+                    (check_point_sampling<3> () == 0)) ? 0 : 1;
+          if (name == "kernels")
+            return ((check_cell_kernels<2> () == 0) &&
+                    (check_cell_kernels<3> () == 0)) ? 0 : 1;
+          if (name == "recycling")
+            return check_recycling ();
+          if (name == "guesses")
+            return check_initial_guesses ();
+          if (name == "multigrid")
+            return check_multigrid ();
+          if (name == "explicit")
+            return check_explicit ();
+          if (name == "imex")
+            return check_imex ();
+          if (name == "budget")
+            return check_cell_budget ();
+          if (name == "allocations")
+            return check_step_allocations ();
+          AssertThrow (false, ExcMessage ("Unknown check " + name));
+        }
+      if ((argc > 1) && (std::string (argv[1]) == "dg"))
+        {
+          BurgerDG<2> burger_dg (1,
+                                 (argc > 2 ? Utilities::string_to_int (argv[2]) : 5),
+                                 (argc > 3 ? Utilities::string_to_double (argv[3]) : 1e-3));
+          burger_dg.run (0.5);
+          return 0;
+        }
+      if ((argc > 1) && (std::string (argv[1]) == "steady"))
+        {
+          Burger<2> burger_equation_solver (argc > 2 ? Utilities::string_to_int (argv[2]) : 3);
+          set_options (burger_equation_solver, options);
+          burger_equation_solver.run_steady ();
+          return 0;
+        }
+      if ((argc > 1) && (std::string (argv[1]) == "compare-solvers"))
+        {
+          Burger<2> burger_equation_solver (argc > 2 ? Utilities::string_to_int (argv[2]) : 3);
+          set_options (burger_equation_solver, options);
+          burger_equation_solver.set_compare_linear_solvers (true);
+          burger_equation_solver.run ();
+          return 0;
+        }
+      if ((argc > 1) && (std::string (argv[1]) == "benchmark"))
+        return run_benchmark_suite (argc > 2 ? argv[2] : "benchmark-baseline.dat",
+                                    (argc > 3) && (std::string (argv[3]) == "update"));
+      if ((argc > 1) && (std::string (argv[1]) == "solver-sweep"))
+        {
+          const unsigned int max_refinements = (argc > 2 ? Utilities::string_to_int (argv[2]) : 7);
+          std::ostringstream table;
+          run_solver_sweep<2> (3, max_refinements, table);
+          run_solver_sweep<3> (2, max_refinements - 3, table);
+          std::cout << table.str ();
+          std::ofstream ("solver-sweep.dat") << table.str ();
+          return 0;
+        }
+      if ((argc > 1) && (std::string (argv[1]) == "convergence"))
+        {
+          // Spatial convergence of Q1 and Q2 with the stationary solver,
+          // and the time dependent run on a fixed mesh at three time steps
+          // against a reference with a 16 times smaller one.
+          ConvergenceStudy<2> study;
+          for (unsigned int degree=1; degree<=2; ++degree)
+            for (unsigned int refinements=2; refinements<=5; ++refinements)
+              study.add (ConvergenceStudy<2>::Configuration (refinements, degree));
+          const double time_steps[] = { 1./50, 1./100, 1./200, 1./3200 };
+          for (unsigned int i=0; i<4; ++i)
+            study.add (ConvergenceStudy<2>::Configuration (3, 1, time_steps[i]));
+
+          study.run ();
+          study.write_table (std::cout);
+          std::ofstream table ("convergence.dat");
+          study.write_table (table);
+          return 0;
+        }
+      if ((argc > 1) && (std::string (argv[1]) == "forcings"))
+        {
+          // Several forcings with one operator, solved as one batch.
+          std::vector<BurgerEnsemble<2>::MemberParameters> parameters;
+          parameters.push_back (BurgerEnsemble<2>::MemberParameters (1.0, 0.2, 1./500, BurgerEnsemble<2>::cavity_forcing));
+          parameters.push_back (BurgerEnsemble<2>::MemberParameters (1.0, 0.1, 1./500, BurgerEnsemble<2>::cavity_forcing));
+          parameters.push_back (BurgerEnsemble<2>::MemberParameters (1.0, 0.2, 1./500, BurgerEnsemble<2>::manufactured_forcing));
+          parameters.push_back (BurgerEnsemble<2>::MemberParameters (1.0, 0.2, 1./500, BurgerEnsemble<2>::unforced));
+
+          BurgerEnsemble<2> ensemble (parameters, 5,
+                                      BurgerEnsemble<2>::explicit_convection,
+                                      /*batched = */ true);
+          ensemble.run (0.1);
+          return 0;
+        }
+      if ((argc > 1) && (std::string (argv[1]) == "ensemble"))
+        {
+          // Sweep over viscosity and forcing period of the cavity problem.
+          std::vector<BurgerEnsemble<2>::MemberParameters> parameters;
+          const double viscosities[] = { 1.0, 0.1, 0.01 };
+          const double periods[]     = { 0.1, 0.2 };
+          for (unsigned int i=0; i<3; ++i)
+            for (unsigned int j=0; j<2; ++j)
+              parameters.push_back (BurgerEnsemble<2>::MemberParameters (viscosities[i], periods[j]));
+
+          BurgerEnsemble<2> ensemble (parameters);
+          ensemble.run (0.1);
+          return 0;
+        }
+
+      // The stabilization is a comma separated list of terms, see
+      // Stabilization::parse_terms().
+      const int dim = (argc > 1 ? Utilities::string_to_int (argv[1]) : 2);
+      const unsigned int n_global_refinements
+        = (argc > 2 ? Utilities::string_to_int (argv[2]) : (dim == 3 ? 2 : 3));
+      const std::string stabilization (argc > 3 ? argv[3] : "none");
+
+      switch (dim)
+        {
+        case 2:
+          {
+            Burger<2> burger_equation_solver (n_global_refinements);
+            burger_equation_solver.set_stabilization (Stabilization<2>::parse_terms (stabilization));
+            set_options (burger_equation_solver, options);
+            burger_equation_solver.run();
+            break;
+          }
+        case 3:
+          {
+            Burger<3> burger_equation_solver (n_global_refinements);
+            burger_equation_solver.set_stabilization (Stabilization<3>::parse_terms (stabilization));
+            set_options (burger_equation_solver, options);
+            burger_equation_solver.run();
+            break;
+          }
+        default:
+          AssertThrow (false, ExcNotImplemented());
+        }
     }
   catch (std::exception &exc)
     {
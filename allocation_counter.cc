@@ -0,0 +1,37 @@
+/*
+ * Counting replacement of the global operator new, for the allocation
+ * check of Burger only. CMake builds this file as a shared module that is
+ * preloaded (LD_PRELOAD) into an unchanged Burger; its operator new then
+ * takes the place of the one of the C++ runtime, in Burger and in the
+ * deal.II library alike. Burger reads the count through
+ * burger_n_allocations(), see AllocationCounter in Burger.cc. The array
+ * forms of the C++ runtime forward to the operators below.
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+  std::atomic<std::size_t> n_allocations (0);
+}
+
+extern "C" std::size_t burger_n_allocations ()
+{
+  return n_allocations;
+}
+
+void *operator new (std::size_t size)
+{
+  ++n_allocations;
+  void *p = std::malloc (size > 0 ? size : 1);
+  if (p == 0)
+    throw std::bad_alloc ();
+  return p;
+}
+
+void operator delete (void *p) noexcept
+{
+  std::free (p);
+}
@@ -0,0 +1,1025 @@
+#ifndef convection_diffusion_h
+#define convection_diffusion_h
+
+#include <deal.II/base/utilities.h>
+#include <deal.II/base/multithread_info.h>
+#include <deal.II/base/thread_management.h>
+#include <deal.II/base/quadrature_lib.h>
+#include <deal.II/base/function.h>
+#include <deal.II/lac/vector.h>
+#include <deal.II/lac/full_matrix.h>
+#include <deal.II/lac/dynamic_sparsity_pattern.h>
+#include <deal.II/lac/sparse_matrix.h>
+#include <deal.II/lac/solver_gmres.h>
+#include <deal.II/lac/vector_memory.h>
+#include <deal.II/lac/precondition.h>
+#include <deal.II/lac/constraint_matrix.h>
+#include <deal.II/grid/tria.h>
+#include <deal.II/grid/grid_generator.h>
+#include <deal.II/grid/grid_refinement.h>
+#include <deal.II/grid/tria_accessor.h>
+#include <deal.II/grid/tria_iterator.h>
+#include <deal.II/dofs/dof_handler.h>
+#include <deal.II/dofs/dof_accessor.h>
+#include <deal.II/dofs/dof_tools.h>
+#include <deal.II/fe/fe_system.h>
+#include <deal.II/fe/fe_q.h>
+#include <deal.II/fe/fe_values.h>
+#include <deal.II/numerics/data_out.h>
+#include <deal.II/numerics/vector_tools.h>
+#include <deal.II/numerics/error_estimator.h>
+#include <deal.II/numerics/solution_transfer.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * A time dependent convection-diffusion solver, and the cell operator of
+ * the Burgers equation.
+ *
+ * Problem<dim,Physics> owns the mesh, the degrees of freedom and the time
+ * loop with adaptive refinement; the Physics class only provides the
+ * quadrature point data of a cell and the integrands of the cell matrix
+ * and right hand side. Physics is a template argument, so the integrands
+ * are inlined into the assembly loop. plot/Convection.cc runs Problem with
+ * ScalarConvection.
+ *
+ * A Physics class has to provide
+ *
+ *  - n_components, the extractor type Extractor and the view type View,
+ *  - reinit(), which evaluates the old solutions and the right hand side
+ *    at the quadrature points of a cell,
+ *  - matrix_entry() and rhs_entry() for the shape functions i and j at a
+ *    quadrature point,
+ *  - component_names() and component_interpretation() for the output.
+ *
+ * Burger is not a Problem: Burger.cc keeps its own driver, since its
+ * multigrid, time integrators, remeshing strategies and diagnostics have
+ * no counterpart here. What the two programs share is in this file: the
+ * implicit Euler cell operator VectorBurgers and its compile-time
+ * specialized kernels, the parallel construction of the sparsity pattern
+ * and the sizing of the vectors after remeshing. A change to these applies
+ * to both; a change to either time loop does not.
+ */
+namespace ConvectionDiffusion
+{
+  using namespace dealii;
+
+
+  /*
+   * Scalar convection-diffusion u_t + beta.grad u - nu Laplace u = f with
+   * a prescribed velocity beta, one component per space direction. The
+   * convection is skew-symmetrized with theta_skew and split between the
+   * new and the extrapolated old time level with theta_imex; the term
+   * dt^2/6 (beta.grad u, beta.grad v) is the Taylor-Galerkin streamline
+   * diffusion of the original Convection program.
+   *
+   * With supg, the SUPG term tau_K (R(u), beta.grad v) is added, with the
+   * strong residual of the step
+   *   R(u) = u - u^n + dt (theta_imex beta.grad u
+   *                        + (1-theta_imex) beta.grad u_extrapolated - f)
+   * (beta is divergence free and the viscous part vanishes for Q1) and the
+   * cell-wise tau_K = ((2/dt)^2 + (2|beta|/h)^2 + (4 nu/h^2)^2)^{-1/2}, as
+   * in the Stabilization class of Burger.cc. This is the cell parameter the
+   * original program computed from the cell diameter but did not use.
+   */
+  template <int dim>
+  class ScalarConvection
+  {
+  public:
+    static const unsigned int          n_components = 1;
+    typedef FEValuesExtractors::Scalar Extractor;
+    typedef FEValuesViews::Scalar<dim> View;
+
+    ScalarConvection (const std::vector<std::shared_ptr<const Function<dim> > > &velocity,
+                      const double nu,
+                      const double theta_imex = 0.5,
+                      const double theta_skew = 0.5,
+                      const bool   supg       = false);
+
+    static double advection (const double          theta_skew,
+                             const Tensor<1, dim> &beta,
+                             const double          u_val,
+                             const Tensor<1, dim> &u_grad,
+                             const double          v_val,
+                             const Tensor<1, dim> &v_grad)
+    {
+      return ( (1 - theta_skew) * (beta * u_grad) * v_val
+               -
+               theta_skew * (beta * v_grad) * u_val );
+    }
+
+    /*
+     * Cell matrix integrand for the test function phi_i and the trial
+     * function phi_j.
+     */
+    static double operator_entry (const double          nu,
+                                  const double          time_step,
+                                  const double          theta_imex,
+                                  const double          theta_skew,
+                                  const Tensor<1, dim> &beta,
+                                  const double          phi_i,
+                                  const Tensor<1, dim> &grad_phi_i,
+                                  const double          phi_j,
+                                  const Tensor<1, dim> &grad_phi_j)
+    {
+      return ( phi_j * phi_i
+               +
+               time_step * ( theta_imex * advection (theta_skew, beta,
+                                                     phi_j, grad_phi_j,
+                                                     phi_i, grad_phi_i)
+                             +
+                             (1 + theta_skew) * nu * (grad_phi_j * grad_phi_i) )
+               +
+               time_step * time_step / 6 * (beta * grad_phi_j) * (beta * grad_phi_i) );
+    }
+
+    void reinit (const FEValues<dim>  &fe_values,
+                 const View           &view,
+                 const Vector<double> &old_solution,
+                 const Vector<double> &old_old_solution,
+                 const Function<dim>  &right_hand_side,
+                 const double          time_step);
+
+    double matrix_entry (const unsigned int    q,
+                         const double          phi_i,
+                         const Tensor<1, dim> &grad_phi_i,
+                         const double          phi_j,
+                         const Tensor<1, dim> &grad_phi_j) const
+    {
+      return ( operator_entry (nu, time_step, theta_imex, theta_skew, beta[q],
+                               phi_i, grad_phi_i, phi_j, grad_phi_j)
+               +
+               tau * (phi_j + time_step * theta_imex * (beta[q] * grad_phi_j))
+               * (beta[q] * grad_phi_i) );
+    }
+
+    double rhs_entry (const unsigned int    q,
+                      const double          phi_i,
+                      const Tensor<1, dim> &grad_phi_i) const
+    {
+      const double         extrapolated      = 2. * old_values[q] - old_old_values[q];
+      const Tensor<1, dim> extrapolated_grad = 2. * old_grad[q] - old_old_grad[q];
+
+      return ( old_values[q] * phi_i
+               +
+               time_step * ( rhs_values[q] * phi_i
+                             -
+                             (1 - theta_imex) * advection (theta_skew, beta[q],
+                                                           extrapolated, extrapolated_grad,
+                                                           phi_i, grad_phi_i)
+                             -
+                             (1 - theta_imex) * nu * (extrapolated_grad * grad_phi_i) )
+               +
+               tau * (old_values[q]
+                      + time_step * (rhs_values[q] - (1 - theta_imex) * (beta[q] * extrapolated_grad)))
+               * (beta[q] * grad_phi_i) );
+    }
+
+    static std::vector<std::string> component_names ();
+    static std::vector<DataComponentInterpretation::DataComponentInterpretation>
+    component_interpretation ();
+
+  private:
+    const std::vector<std::shared_ptr<const Function<dim> > > velocity;
+    const double nu;
+    const double theta_imex;
+    const double theta_skew;
+    const bool   supg;
+    double       time_step;
+    double       tau;
+
+    std::vector<Tensor<1, dim> > beta;
+    std::vector<double>          old_values;
+    std::vector<double>          old_old_values;
+    std::vector<Tensor<1, dim> > old_grad;
+    std::vector<Tensor<1, dim> > old_old_grad;
+    std::vector<double>          rhs_values;
+    std::vector<double>          velocity_values;
+  };
+
+
+
+  template <int dim>
+  ScalarConvection<dim>::ScalarConvection (const std::vector<std::shared_ptr<const Function<dim> > > &velocity,
+                                           const double nu,
+                                           const double theta_imex,
+                                           const double theta_skew,
+                                           const bool   supg)
+    :
+    velocity (velocity),
+    nu (nu),
+    theta_imex (theta_imex),
+    theta_skew (theta_skew),
+    supg (supg),
+    time_step (0),
+    tau (0)
+  {
+    Assert (velocity.size() == dim, ExcDimensionMismatch (velocity.size(), dim));
+  }
+
+
+
+  template <int dim>
+  void ScalarConvection<dim>::reinit (const FEValues<dim>  &fe_values,
+                                      const View           &view,
+                                      const Vector<double> &old_solution,
+                                      const Vector<double> &old_old_solution,
+                                      const Function<dim>  &right_hand_side,
+                                      const double          time_step)
+  {
+    const unsigned int n_q_points = fe_values.n_quadrature_points;
+
+    this->time_step = time_step;
+    beta.resize (n_q_points);
+    old_values.resize (n_q_points);
+    old_old_values.resize (n_q_points);
+    old_grad.resize (n_q_points);
+    old_old_grad.resize (n_q_points);
+    rhs_values.resize (n_q_points);
+    velocity_values.resize (n_q_points);
+
+    view.get_function_values (old_solution, old_values);
+    view.get_function_values (old_old_solution, old_old_values);
+    view.get_function_gradients (old_solution, old_grad);
+    view.get_function_gradients (old_old_solution, old_old_grad);
+
+    right_hand_side.value_list (fe_values.get_quadrature_points(), rhs_values);
+
+    for (unsigned int d=0; d<dim; ++d)
+      {
+        velocity[d]->value_list (fe_values.get_quadrature_points(), velocity_values);
+        for (unsigned int q=0; q<n_q_points; ++q)
+          beta[q][d] = velocity_values[q];
+      }
+
+    tau = 0;
+    if (supg)
+      {
+        const double h = fe_values.get_cell()->diameter ();
+        double beta_max = 0;
+        for (unsigned int q=0; q<n_q_points; ++q)
+          beta_max = std::max (beta_max, beta[q].norm());
+        tau = 1. / std::sqrt (std::pow (2. / time_step, 2) +
+                              std::pow (2. * beta_max / h, 2) +
+                              std::pow (4. * nu / (h * h), 2));
+      }
+  }
+
+
+
+  template <int dim>
+  std::vector<std::string>
+  ScalarConvection<dim>::component_names ()
+  {
+    return std::vector<std::string> (1, "temperature");
+  }
+
+
+
+  template <int dim>
+  std::vector<DataComponentInterpretation::DataComponentInterpretation>
+  ScalarConvection<dim>::component_interpretation ()
+  {
+    return std::vector<DataComponentInterpretation::DataComponentInterpretation>
+           (1, DataComponentInterpretation::component_is_scalar);
+  }
+
+
+
+  /*
+   * Cell operator of the vector Burgers equation u_t + (u.grad) u
+   * - nu Laplace u = f, linearized with the convection velocity u* = u^n
+   * and stepped with implicit Euler. The term 1/2 (div u*) u makes the
+   * convection skew-symmetric. Burger.cc has its own driver, so this is
+   * only the integrand of the cell matrix, used by Burger and
+   * BurgerEnsemble and as the reference of VectorBurgersKernel below; it
+   * is not a Physics class for Problem.
+   */
+  template <int dim>
+  struct VectorBurgers
+  {
+    static double operator_entry (const double          nu,
+                                  const double          time_step,
+                                  const Tensor<1, dim> &u_star,
+                                  const double          u_star_div,
+                                  const Tensor<1, dim> &phi_i,
+                                  const Tensor<2, dim> &grad_phi_i,
+                                  const Tensor<1, dim> &phi_j,
+                                  const Tensor<2, dim> &grad_phi_j)
+    {
+      return ( phi_i * phi_j
+               +
+               time_step * contract3 (u_star, grad_phi_i, phi_j)
+               +
+               0.5 * time_step * u_star_div * (phi_i * phi_j)
+               +
+               nu * time_step * double_contract (grad_phi_i, grad_phi_j) );
+    }
+  };
+
+
+
+  /*
+   * base^exponent as a compile-time constant.
+   */
+  template <int base, int exponent>
+  struct Power
+  {
+    static const unsigned int value = base * Power<base, exponent-1>::value;
+  };
+
+  template <int base>
+  struct Power<base, 0>
+  {
+    static const unsigned int value = 1;
+  };
+
+
+
+  /*
+   * The cell matrix of VectorBurgers for FESystem(FE_Q(fe_degree), dim)
+   * and n_q_points_1d^dim quadrature points, with all loop bounds known at
+   * compile time and the local matrix in a std::array. Every shape function
+   * of this element is nonzero in a single component c(i) only, so
+   *
+   *   phi_i . phi_j                = delta_{c(i)c(j)} phi_i phi_j,
+   *   grad phi_i : grad phi_j      = delta_{c(i)c(j)} grad phi_i . grad phi_j,
+   *   u* . (grad phi_i) phi_j      = u*_{c(i)} d_{c(j)} phi_i phi_j,
+   *
+   * and the kernel works on the scalar shape values and gradients, which are
+   * copied out of the FEValues object once per cell.
+   */
+  template <int dim, int fe_degree, int n_q_points_1d>
+  struct VectorBurgersKernel
+  {
+    static const unsigned int dofs_per_cell = dim * Power<fe_degree+1, dim>::value;
+    static const unsigned int n_q_points    = Power<n_q_points_1d, dim>::value;
+
+    static void cell_matrix (const FEValues<dim>                &fe_values,
+                             const std::vector<Tensor<1, dim> > &u_star,
+                             const std::vector<double>          &u_star_div,
+                             const double                        nu,
+                             const double                        time_step,
+                             FullMatrix<double>                 &cell_matrix)
+    {
+      const FiniteElement<dim> &fe = fe_values.get_fe();
+
+      std::array<unsigned int, dofs_per_cell>               component;
+      std::array<double, n_q_points *dofs_per_cell>         values;
+      std::array<Tensor<1, dim>, n_q_points *dofs_per_cell> gradients;
+      std::array<double, dofs_per_cell *dofs_per_cell>      local_matrix;
+
+      for (unsigned int i=0; i<dofs_per_cell; ++i)
+        component[i] = fe.system_to_component_index (i).first;
+      for (unsigned int q=0; q<n_q_points; ++q)
+        for (unsigned int i=0; i<dofs_per_cell; ++i)
+          {
+            values[q*dofs_per_cell+i]    = fe_values.shape_value (i, q);
+            gradients[q*dofs_per_cell+i] = fe_values.shape_grad (i, q);
+          }
+
+      local_matrix.fill (0);
+      for (unsigned int q=0; q<n_q_points; ++q)
+        {
+          const double          JxW            = fe_values.JxW (q);
+          const double          mass_factor    = (1 + 0.5 * time_step * u_star_div[q]) * JxW;
+          const double          viscous_factor = nu * time_step * JxW;
+          const Tensor<1, dim>  convection     = time_step * JxW * u_star[q];
+          const double         *phi            = &values[q*dofs_per_cell];
+          const Tensor<1, dim> *grad_phi       = &gradients[q*dofs_per_cell];
+
+          for (unsigned int i=0; i<dofs_per_cell; ++i)
+            {
+              const unsigned int c_i          = component[i];
+              const double       convection_i = convection[c_i];
+
+              for (unsigned int j=0; j<dofs_per_cell; ++j)
+                {
+                  double entry = convection_i * grad_phi[i][component[j]] * phi[j];
+                  if (component[j] == c_i)
+                    entry += mass_factor * phi[i] * phi[j]
+                             + viscous_factor * (grad_phi[i] * grad_phi[j]);
+                  local_matrix[i*dofs_per_cell+j] += entry;
+                }
+            }
+        }
+
+      for (unsigned int i=0; i<dofs_per_cell; ++i)
+        for (unsigned int j=0; j<dofs_per_cell; ++j)
+          cell_matrix(i,j) = local_matrix[i*dofs_per_cell+j];
+    }
+  };
+
+
+
+  /*
+   * Fills cell_matrix with the VectorBurgers operator through one of the
+   * specialized kernels for Q1 and Q2 with the Gauss rules used here.
+   * Returns false for any other element or quadrature, in which case the
+   * caller has to run the generic loop over operator_entry().
+   */
+  template <int dim>
+  bool vector_burgers_cell_matrix (const FEValues<dim>                &fe_values,
+                                   const std::vector<Tensor<1, dim> > &u_star,
+                                   const std::vector<double>          &u_star_div,
+                                   const double                        nu,
+                                   const double                        time_step,
+                                   FullMatrix<double>                 &cell_matrix)
+  {
+    const FiniteElement<dim> &fe         = fe_values.get_fe();
+    const unsigned int        n_q_points = fe_values.n_quadrature_points;
+
+    if (!fe.is_primitive() || (fe.n_components() != dim))
+      return false;
+
+    if ((fe.degree == 1) && (fe.dofs_per_cell == VectorBurgersKernel<dim,1,2>::dofs_per_cell))
+      {
+        if (n_q_points == VectorBurgersKernel<dim,1,2>::n_q_points)
+          {
+            VectorBurgersKernel<dim,1,2>::cell_matrix (fe_values, u_star, u_star_div,
+                                                       nu, time_step, cell_matrix);
+            return true;
+          }
+        if (n_q_points == VectorBurgersKernel<dim,1,3>::n_q_points)
+          {
+            VectorBurgersKernel<dim,1,3>::cell_matrix (fe_values, u_star, u_star_div,
+                                                       nu, time_step, cell_matrix);
+            return true;
+          }
+      }
+
+    if ((fe.degree == 2) && (fe.dofs_per_cell == VectorBurgersKernel<dim,2,3>::dofs_per_cell))
+      {
+        if (n_q_points == VectorBurgersKernel<dim,2,3>::n_q_points)
+          {
+            VectorBurgersKernel<dim,2,3>::cell_matrix (fe_values, u_star, u_star_div,
+                                                       nu, time_step, cell_matrix);
+            return true;
+          }
+        if (n_q_points == VectorBurgersKernel<dim,2,4>::n_q_points)
+          {
+            VectorBurgersKernel<dim,2,4>::cell_matrix (fe_values, u_star, u_star_div,
+                                                       nu, time_step, cell_matrix);
+            return true;
+          }
+      }
+
+    return false;
+  }
+
+
+
+  namespace internal
+  {
+    /*
+     * Couplings of the cells [begin,end) of cells, with constrained DoFs
+     * extended by their masters as distribute_local_to_global() will write
+     * them.
+     */
+    template <int dim>
+    void add_cell_couplings (const std::vector<typename DoFHandler<dim>::active_cell_iterator> *cells,
+                             const unsigned int                                                begin,
+                             const unsigned int                                                end,
+                             const ConstraintMatrix                                           *constraints,
+                             DynamicSparsityPattern                                           *pattern)
+    {
+      if (begin == end)
+        return;
+
+      std::vector<types::global_dof_index> local_dof_indices ((*cells)[begin]->get_fe().dofs_per_cell);
+      for (unsigned int i=begin; i<end; ++i)
+        {
+          (*cells)[i]->get_dof_indices (local_dof_indices);
+          constraints->add_entries_local_to_global (local_dof_indices, *pattern,
+                                                    /*keep_constrained_entries = */ true);
+        }
+    }
+
+
+
+    /*
+     * Adds the rows [begin_row,end_row) of all patterns to sparsity_pattern.
+     */
+    inline
+    void copy_sparsity_rows (const std::vector<DynamicSparsityPattern> *patterns,
+                             const types::global_dof_index              begin_row,
+                             const types::global_dof_index              end_row,
+                             SparsityPattern                           *sparsity_pattern)
+    {
+      for (types::global_dof_index row=begin_row; row<end_row; ++row)
+        for (unsigned int c=0; c<patterns->size(); ++c)
+          {
+            const DynamicSparsityPattern &pattern = (*patterns)[c];
+            for (unsigned int k=0; k<pattern.row_length (row); ++k)
+              sparsity_pattern->add (row, pattern.column_number (row, k));
+          }
+    }
+  }
+
+
+
+  /*
+   * The sparsity pattern of dof_handler with constraints, built in
+   * parallel. The active cells are split into one contiguous range per
+   * thread. Each task collects the couplings of its cells in a
+   * DynamicSparsityPattern of its own. The final pattern is then sized
+   * with the sum of the row lengths of these patterns, an upper bound that
+   * compress() trims, and filled by tasks over disjoint row ranges, so that
+   * no two tasks write the same row.
+   */
+  template <int dim>
+  void make_sparsity_pattern (const DoFHandler<dim>  &dof_handler,
+                              const ConstraintMatrix &constraints,
+                              SparsityPattern        &sparsity_pattern)
+  {
+    std::vector<typename DoFHandler<dim>::active_cell_iterator> cells;
+    cells.reserve (dof_handler.get_tria().n_active_cells());
+    for (typename DoFHandler<dim>::active_cell_iterator
+         cell = dof_handler.begin_active(); cell != dof_handler.end(); ++cell)
+      cells.push_back (cell);
+
+    const types::global_dof_index n_dofs   = dof_handler.n_dofs();
+    const unsigned int            n_chunks = std::max (1u, std::min<unsigned int> (MultithreadInfo::n_threads(),
+                                                       cells.size()));
+
+    std::vector<DynamicSparsityPattern> patterns (n_chunks, DynamicSparsityPattern (n_dofs, n_dofs));
+    {
+      Threads::TaskGroup<> tasks;
+      for (unsigned int c=0; c<n_chunks; ++c)
+        tasks += Threads::new_task (&internal::add_cell_couplings<dim>,
+                                    &cells,
+                                    c * cells.size() / n_chunks,
+                                    (c+1) * cells.size() / n_chunks,
+                                    &constraints,
+                                    &patterns[c]);
+      tasks.join_all ();
+    }
+
+    std::vector<unsigned int> row_lengths (n_dofs, 0);
+    for (types::global_dof_index row=0; row<n_dofs; ++row)
+      {
+        for (unsigned int c=0; c<n_chunks; ++c)
+          row_lengths[row] += patterns[c].row_length (row);
+        row_lengths[row] = std::min<unsigned int> (row_lengths[row], n_dofs);
+      }
+    sparsity_pattern.reinit (n_dofs, n_dofs, row_lengths);
+
+    {
+      Threads::TaskGroup<> tasks;
+      for (unsigned int c=0; c<n_chunks; ++c)
+        tasks += Threads::new_task (&internal::copy_sparsity_rows,
+                                    &patterns,
+                                    types::global_dof_index (c * n_dofs / n_chunks),
+                                    types::global_dof_index ((c+1) * n_dofs / n_chunks),
+                                    &sparsity_pattern);
+      tasks.join_all ();
+    }
+    sparsity_pattern.compress ();
+  }
+
+
+
+  /*
+   * Sets the size of vectors to n. deal.II vectors keep their memory when
+   * they shrink. When they have to grow, capacity is raised to a quarter
+   * more than n and the memory allocated for that, so that the next
+   * adaptation steps fit into it.
+   */
+  inline
+  void resize_vectors (Vector<double> *const        *vectors,
+                       const unsigned int            n_vectors,
+                       const types::global_dof_index n,
+                       types::global_dof_index      &capacity)
+  {
+    const bool grow = (n > capacity);
+    if (grow)
+      capacity = n + n/4;
+
+    for (unsigned int v=0; v<n_vectors; ++v)
+      {
+        if (grow)
+          vectors[v]->reinit (capacity);
+        vectors[v]->reinit (n);
+      }
+  }
+
+
+
+  /*
+   * Time loop on [-1,1]^dim with homogeneous Dirichlet conditions: adaptive
+   * pre-refinement on the initial condition, remeshing every
+   * remesh_interval steps with the fixed number strategy, GMRES with SSOR,
+   * the L2 error against exact_solution in l2_error.dat and the solution in
+   * solution-NNN.vtk every snapshot_interval steps. The defaults are those
+   * of Burger's fixed_number strategy and snapshots; set_refinement() and
+   * set_snapshot_interval() change them. The sparsity pattern and the
+   * vector sizing after remeshing are the ones of Burger, and the assembly
+   * workspace is kept across time steps.
+   */
+  template <int dim, class Physics>
+  class Problem
+  {
+  public:
+    Problem (const Physics      &physics,
+             const Function<dim> &initial_values,
+             Function<dim>       &right_hand_side,
+             Function<dim>       &exact_solution,
+             const double         time_step,
+             const double         final_time,
+             const unsigned int   n_global_refinements = 4,
+             const unsigned int   fe_degree            = 1);
+    ~Problem ();
+
+    void set_refinement (const double       refine_fraction,
+                         const double       coarsen_fraction,
+                         const unsigned int n_pre_refinement_steps,
+                         const unsigned int remesh_interval);
+    void set_snapshot_interval (const unsigned int interval);
+
+    void run ();
+
+  private:
+    void make_grid ();
+    void setup_system ();
+    void assemble_system ();
+    void solve ();
+    void refine_grid (const unsigned int min_grid_level,
+                      const unsigned int max_grid_level);
+    void output_results () const;
+
+    Physics              physics;
+
+    const Function<dim> &initial_values;
+    Function<dim>       &right_hand_side;
+    Function<dim>       &exact_solution;
+
+    Triangulation<dim>   triangulation;
+    FESystem<dim>        fe;
+    DoFHandler<dim>      dof_handler;
+
+    // Assembly workspace, kept across time steps.
+    const QGauss<dim>                    quadrature_formula;
+    FEValues<dim>                        fe_values;
+    FullMatrix<double>                   cell_matrix;
+    Vector<double>                       cell_rhs;
+    std::vector<types::global_dof_index> local_dof_indices;
+
+    ConstraintMatrix     constraints;
+
+    SparsityPattern      sparsity_pattern;
+    SparseMatrix<double> system_matrix;
+
+    GrowingVectorMemory<Vector<double> > vector_memory;
+
+    Vector<double>       old_solution;
+    Vector<double>       old_old_solution;
+    Vector<double>       solution;
+    Vector<double>       system_rhs;
+    types::global_dof_index vector_capacity;
+
+    unsigned int         timestep_number;
+    const double         time_step;
+    double               time;
+    const double         final_time;
+
+    const unsigned int   n_global_refinements;
+
+    double               refine_fraction;
+    double               coarsen_fraction;
+    unsigned int         n_pre_refinement_steps;
+    unsigned int         remesh_interval;
+    unsigned int         snapshot_interval;
+  };
+
+
+
+  template <int dim, class Physics>
+  Problem<dim,Physics>::Problem (const Physics       &physics,
+                                 const Function<dim> &initial_values,
+                                 Function<dim>       &right_hand_side,
+                                 Function<dim>       &exact_solution,
+                                 const double         time_step,
+                                 const double         final_time,
+                                 const unsigned int   n_global_refinements,
+                                 const unsigned int   fe_degree)
+    :
+    physics (physics),
+    initial_values (initial_values),
+    right_hand_side (right_hand_side),
+    exact_solution (exact_solution),
+    fe (FE_Q<dim>(fe_degree), Physics::n_components),
+    dof_handler (triangulation),
+    quadrature_formula (fe_degree+1),
+    fe_values (fe, quadrature_formula,
+               update_values   | update_gradients |
+               update_quadrature_points | update_JxW_values),
+    cell_matrix (fe.dofs_per_cell, fe.dofs_per_cell),
+    cell_rhs (fe.dofs_per_cell),
+    local_dof_indices (fe.dofs_per_cell),
+    vector_capacity (0),
+    timestep_number (0),
+    time_step (time_step),
+    time (0),
+    final_time (final_time),
+    n_global_refinements (n_global_refinements),
+    refine_fraction (0.5),
+    coarsen_fraction (0.2),
+    n_pre_refinement_steps (4),
+    remesh_interval (5),
+    snapshot_interval (50)
+  {}
+
+
+
+  template <int dim, class Physics>
+  Problem<dim,Physics>::~Problem ()
+  {
+    dof_handler.clear ();
+  }
+
+
+
+  template <int dim, class Physics>
+  void Problem<dim,Physics>::set_refinement (const double       refine_fraction,
+                                             const double       coarsen_fraction,
+                                             const unsigned int n_pre_refinement_steps,
+                                             const unsigned int remesh_interval)
+  {
+    AssertThrow (remesh_interval > 0, ExcMessage ("remesh_interval has to be positive"));
+    this->refine_fraction        = refine_fraction;
+    this->coarsen_fraction       = coarsen_fraction;
+    this->n_pre_refinement_steps = n_pre_refinement_steps;
+    this->remesh_interval        = remesh_interval;
+  }
+
+
+
+  template <int dim, class Physics>
+  void Problem<dim,Physics>::set_snapshot_interval (const unsigned int interval)
+  {
+    snapshot_interval = interval;
+  }
+
+
+
+  template <int dim, class Physics>
+  void Problem<dim,Physics>::make_grid ()
+  {
+    GridGenerator::hyper_cube (triangulation, -1, 1);
+    triangulation.refine_global (n_global_refinements);
+
+    std::cout << "   Number of active cells: "
+              << triangulation.n_active_cells()
+              << std::endl
+              << "   Total number of cells: "
+              << triangulation.n_cells()
+              << std::endl;
+  }
+
+
+
+  template <int dim, class Physics>
+  void Problem<dim,Physics>::setup_system ()
+  {
+    dof_handler.distribute_dofs (fe);
+
+    std::cout << "   Number of degrees of freedom: "
+              << dof_handler.n_dofs()
+              << std::endl;
+
+    constraints.clear ();
+    DoFTools::make_hanging_node_constraints (dof_handler,
+                                             constraints);
+    VectorTools::interpolate_boundary_values (dof_handler,
+                                              0,
+                                              ZeroFunction<dim>(Physics::n_components),
+                                              constraints);
+    constraints.close ();
+
+    ConvectionDiffusion::make_sparsity_pattern (dof_handler, constraints, sparsity_pattern);
+
+    system_matrix.reinit (sparsity_pattern);
+
+    Vector<double> *const vectors[] = { &solution, &old_solution, &old_old_solution, &system_rhs };
+    ConvectionDiffusion::resize_vectors (vectors, sizeof(vectors)/sizeof(vectors[0]),
+                                         dof_handler.n_dofs(), vector_capacity);
+  }
+
+
+
+  template <int dim, class Physics>
+  void Problem<dim,Physics>::assemble_system ()
+  {
+    system_matrix = 0;
+    system_rhs    = 0;
+
+    right_hand_side.set_time (time);
+
+    const unsigned int   dofs_per_cell = fe.dofs_per_cell;
+    const unsigned int   n_q_points    = quadrature_formula.size();
+
+    const typename Physics::Extractor components (0);
+
+    typename DoFHandler<dim>::active_cell_iterator
+    cell = dof_handler.begin_active(),
+    endc = dof_handler.end();
+
+    for (; cell!=endc; ++cell)
+      {
+        fe_values.reinit (cell);
+        const typename Physics::View &view = fe_values[components];
+
+        physics.reinit (fe_values, view, old_solution, old_old_solution,
+                        right_hand_side, time_step);
+
+        cell_matrix = 0;
+        cell_rhs    = 0;
+
+        for (unsigned int q_index=0; q_index<n_q_points; ++q_index)
+          for (unsigned int i=0; i<dofs_per_cell; ++i)
+            {
+              const typename Physics::View::value_type    phi_i      = view.value (i, q_index);
+              const typename Physics::View::gradient_type grad_phi_i = view.gradient (i, q_index);
+
+              for (unsigned int j=0; j<dofs_per_cell; ++j)
+                cell_matrix(i,j) += physics.matrix_entry (q_index,
+                                                          phi_i, grad_phi_i,
+                                                          view.value (j, q_index),
+                                                          view.gradient (j, q_index))
+                                    * fe_values.JxW (q_index);
+
+              cell_rhs(i) += physics.rhs_entry (q_index, phi_i, grad_phi_i)
+                             * fe_values.JxW (q_index);
+            }
+
+        cell->get_dof_indices (local_dof_indices);
+        constraints.distribute_local_to_global (cell_matrix,
+                                                cell_rhs,
+                                                local_dof_indices,
+                                                system_matrix,
+                                                system_rhs);
+      }
+  }
+
+
+
+  template <int dim, class Physics>
+  void Problem<dim,Physics>::solve ()
+  {
+    PreconditionSSOR<> preconditioner;
+    preconditioner.initialize (system_matrix, 1.0);
+
+    SolverControl solver_control (5000, 1e-9 * system_rhs.l2_norm());
+    SolverGMRES<Vector<double> > gmres (solver_control, vector_memory,
+                                        SolverGMRES<Vector<double> >::AdditionalData (30));
+    gmres.solve (system_matrix, solution, system_rhs, preconditioner);
+
+    std::cout << "   " << solver_control.last_step()
+              << " GMRES iterations needed to obtain convergence."
+              << '\n';
+
+    constraints.distribute (solution);
+  }
+
+
+
+  template <int dim, class Physics>
+  void Problem<dim,Physics>::refine_grid (const unsigned int min_grid_level,
+                                          const unsigned int max_grid_level)
+  {
+    Vector<float> estimated_error_per_cell (triangulation.n_active_cells());
+
+    KellyErrorEstimator<dim>::estimate (dof_handler,
+                                        QGauss<dim-1>(fe.degree+2),
+                                        typename FunctionMap<dim>::type(),
+                                        solution,
+                                        estimated_error_per_cell);
+
+    GridRefinement::refine_and_coarsen_fixed_number (triangulation,
+                                                     estimated_error_per_cell,
+                                                     refine_fraction, coarsen_fraction);
+
+    if (triangulation.n_levels() > max_grid_level)
+      for (typename Triangulation<dim>::active_cell_iterator
+           cell = triangulation.begin_active(max_grid_level);
+           cell != triangulation.end(); ++cell)
+        cell->clear_refine_flag ();
+    for (typename Triangulation<dim>::active_cell_iterator
+         cell = triangulation.begin_active(min_grid_level);
+         cell != triangulation.end_active(min_grid_level); ++cell)
+      cell->clear_coarsen_flag ();
+
+    SolutionTransfer<dim> solution_transfer (dof_handler);
+
+    Vector<double> previous_solution;
+    previous_solution = solution;
+
+    triangulation.prepare_coarsening_and_refinement ();
+    solution_transfer.prepare_for_coarsening_and_refinement (previous_solution);
+
+    triangulation.execute_coarsening_and_refinement ();
+    setup_system ();
+
+    solution_transfer.interpolate (previous_solution, solution);
+    constraints.distribute (solution);
+  }
+
+
+
+  template <int dim, class Physics>
+  void Problem<dim,Physics>::output_results () const
+  {
+    if ((snapshot_interval == 0) || (timestep_number % snapshot_interval != 0))
+      return;
+
+    DataOut<dim> data_out;
+    data_out.attach_dof_handler (dof_handler);
+    data_out.add_data_vector (solution, Physics::component_names(),
+                              DataOut<dim>::type_dof_data,
+                              Physics::component_interpretation());
+    data_out.build_patches ();
+
+    const std::string filename = "solution-"
+                                 + Utilities::int_to_string (timestep_number, 3) +
+                                 ".vtk";
+    std::ofstream output (filename.c_str());
+    data_out.write_vtk (output);
+  }
+
+
+
+  template <int dim, class Physics>
+  void Problem<dim,Physics>::run ()
+  {
+    std::cout << "Solving problem in " << dim << " space dimensions." << std::endl;
+
+    std::ofstream error_out ("l2_error.dat");
+
+    make_grid ();
+    setup_system ();
+
+    unsigned int pre_refinement_step = 0;
+
+start_time_iteration:
+
+    timestep_number = 0;
+    time            = 0;
+
+    VectorTools::interpolate (dof_handler, initial_values, old_solution);
+    solution = old_solution;
+    output_results ();
+
+    Vector<float> difference_per_cell;
+    do
+      {
+        std::cout << "Time step " << timestep_number << " at t=" << time
+                  << '\n';
+
+        assemble_system ();
+        solve ();
+        output_results ();
+
+        if ((timestep_number == 0) &&
+            (pre_refinement_step < n_pre_refinement_steps))
+          {
+            refine_grid (n_global_refinements,
+                         n_global_refinements + n_pre_refinement_steps);
+            ++pre_refinement_step;
+            goto start_time_iteration;
+          }
+        else if ((timestep_number > 0) && (timestep_number % remesh_interval == 0))
+          {
+            refine_grid (n_global_refinements,
+                         n_global_refinements + n_pre_refinement_steps);
+            old_solution.reinit (solution.size());
+          }
+
+        time += time_step;
+        ++timestep_number;
+
+        difference_per_cell.reinit (triangulation.n_active_cells());
+        exact_solution.set_time (time);
+        VectorTools::integrate_difference (dof_handler,
+                                           solution,
+                                           exact_solution,
+                                           difference_per_cell,
+                                           QGauss<dim>(fe.degree+2),
+                                           VectorTools::L2_norm);
+        error_out << time << "  " << difference_per_cell.l2_norm() << '\n';
+
+        old_old_solution = old_solution;
+        old_solution     = solution;
+        solution         = 0;
+      }
+    while (time <= final_time);
+  }
+}
+
+#endif
@@ -0,0 +1,80 @@
+/*
+ * Reader for the diagnostics log written by Burger (diagnostics.bin).
+ * Prints one line per time step, in the columns
+ *
+ *   1 time  2 L2 error  3 linear iterations  4 final residual
+ *   5 DoFs  6 active cells  7 assembly [s]  8 solve [s]  9 refinement [s]
+ *  10 heap allocations ("-" if Burger ran without the preloaded
+ *     allocation_counter module)
+ *
+ * so that gnuplot can read it through a pipe:
+ *
+ *   plot "< ./read_diagnostics diagnostics.bin" using 1:2
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// Has to match DiagnosticsLog::Record in Burger.cc.
+struct Record
+{
+  double        time;
+  double        l2_error;
+  double        linear_residual;
+  double        assembly_time;
+  double        solve_time;
+  double        refinement_time;
+  std::uint32_t linear_iterations;
+  std::uint32_t n_dofs;
+  std::uint32_t n_cells;
+  std::uint32_t n_allocations;
+};
+
+int main (int argc, char **argv)
+{
+  const char *filename = (argc > 1 ? argv[1] : "diagnostics.bin");
+  std::ifstream in (filename, std::ios::binary);
+  if (!in)
+    {
+      std::cerr << "Could not open " << filename << std::endl;
+      return 1;
+    }
+
+  char          tag[8];
+  std::uint32_t version, record_size;
+  in.read (tag, sizeof(tag));
+  in.read (reinterpret_cast<char *>(&version), sizeof(version));
+  in.read (reinterpret_cast<char *>(&record_size), sizeof(record_size));
+  if (!in || (std::memcmp (tag, "BURGDIAG", sizeof(tag)) != 0)
+      || (version != 2) || (record_size != sizeof(Record)))
+    {
+      std::cerr << filename << " is not a diagnostics log of this version." << std::endl;
+      return 1;
+    }
+
+  std::cout << "# time  L2_error  iterations  residual  dofs  cells"
+            << "  assembly  solve  refinement  allocations" << '\n';
+
+  Record record;
+  while (in.read (reinterpret_cast<char *>(&record), sizeof(record)))
+    {
+      std::cout << record.time << "  "
+                << record.l2_error << "  "
+                << record.linear_iterations << "  "
+                << record.linear_residual << "  "
+                << record.n_dofs << "  "
+                << record.n_cells << "  "
+                << record.assembly_time << "  "
+                << record.solve_time << "  "
+                << record.refinement_time << "  ";
+      // DiagnosticsLog::not_counted
+      if (record.n_allocations == 0xffffffff)
+        std::cout << "-" << '\n';
+      else
+        std::cout << record.n_allocations << '\n';
+    }
+
+  return 0;
+}